@@ -1,6 +1,18 @@
 #include "bitvector.h"
 #include <cstddef>
 #include <random>
+#include <atomic>
+#include <mutex>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BITVECTOR_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define BITVECTOR_NEON_SIMD
+#include <arm_neon.h>
+#endif
 
 namespace REMU::BitVectorUtils {
 
@@ -17,55 +29,265 @@ size_t size_rand() { return size_dist(gen); }
 std::uniform_int_distribution<uint8_t> uint8_dist(0, UINT8_MAX);
 uint8_t uint8_rand() { return size_dist(gen); }
 
-// modified from
-// https://stackoverflow.com/questions/1392059/algorithm-to-generate-bit-mask
-constexpr uint64_t bitmask(uint64_t onecount) {
-  return static_cast<uint64_t>(-(onecount != 0)) &
-         (static_cast<uint64_t>(-1) >> (64 - onecount));
+// Pool allocator
+//
+// Each allocation is preceded by a header block holding its size class
+// (0 for plain new[]), so that it can be freed regardless of whether the
+// pool is enabled at that time.
+
+namespace {
+
+constexpr size_t pool_chunk_blks = 128 * 1024; // 1MB
+
+std::atomic<bool> use_pool(false);
+
+// Free lists left by exited threads, which are taken over by other threads
+std::mutex orphan_mutex;
+uint64_t *orphan_list[pool_max_blks + 1] = {};
+std::atomic<bool> has_orphan[pool_max_blks + 1] = {};
+
+struct PoolCache
+{
+    // free lists of each size class, linked through the first block
+    uint64_t *free_list[pool_max_blks + 1] = {};
+
+    // remaining part of the current chunk
+    uint64_t *chunk = nullptr;
+    size_t chunk_left = 0;
+
+    uint64_t *alloc(size_t blks)
+    {
+        uint64_t *&head = free_list[blks];
+
+        if (!head && has_orphan[blks].load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(orphan_mutex);
+            head = orphan_list[blks];
+            orphan_list[blks] = nullptr;
+            has_orphan[blks].store(false, std::memory_order_relaxed);
+        }
+
+        if (head) {
+            uint64_t *p = head;
+            head = reinterpret_cast<uint64_t *>(p[1]);
+            return p;
+        }
+
+        // header + data
+        size_t n = blks + 1;
+        if (chunk_left < n) {
+            // The rest of the old chunk is abandoned. Chunks are never freed
+            // since blocks may be passed to and freed by other threads.
+            chunk = new uint64_t[pool_chunk_blks];
+            chunk_left = pool_chunk_blks;
+        }
+
+        uint64_t *p = chunk;
+        chunk += n;
+        chunk_left -= n;
+        return p;
+    }
+
+    void free(uint64_t *p, size_t blks)
+    {
+        p[1] = reinterpret_cast<uint64_t>(free_list[blks]);
+        free_list[blks] = p;
+    }
+
+    // Blocks of an exiting thread cannot be deleted as they are carved from
+    // chunks, so its free lists are handed over to other threads
+    ~PoolCache();
+};
+
+thread_local PoolCache pool_cache;
+
+// Set once the cache of this thread is destroyed. Static vectors may still
+// be freed after that, and their blocks go to the orphan lists.
+thread_local bool pool_cache_dead = false;
+
+PoolCache::~PoolCache()
+{
+    pool_cache_dead = true;
+
+    std::lock_guard<std::mutex> lock(orphan_mutex);
+    for (size_t blks = 0; blks <= pool_max_blks; blks++) {
+        uint64_t *head = free_list[blks];
+        if (!head)
+            continue;
+
+        uint64_t *tail = head;
+        while (tail[1])
+            tail = reinterpret_cast<uint64_t *>(tail[1]);
+
+        tail[1] = reinterpret_cast<uint64_t>(orphan_list[blks]);
+        orphan_list[blks] = head;
+        has_orphan[blks].store(true, std::memory_order_relaxed);
+    }
 }
 
-inline void setbits(uint64_t &value, uint64_t new_value, uint64_t width,
-                    uint64_t offset) {
-  uint64_t mask = bitmask(width) << offset;
-  value = (value & ~mask) | ((new_value << offset) & mask);
+};
+
+uint64_t *alloc_blocks(size_t blks)
+{
+    uint64_t *p;
+
+    if (blks <= pool_max_blks && use_pool.load(std::memory_order_relaxed) && !pool_cache_dead) {
+        p = pool_cache.alloc(blks);
+        p[0] = blks;
+    }
+    else {
+        p = new uint64_t[blks + 1];
+        p[0] = 0;
+    }
+
+    return p + 1;
 }
 
-}; // namespace REMU::BitVectorUtils
+void free_blocks(uint64_t *data)
+{
+    uint64_t *p = data - 1;
 
-using namespace REMU;
-class BitsReader
+    if (p[0] == 0)
+        delete[] p;
+    else if (!pool_cache_dead)
+        pool_cache.free(p, p[0]);
+    else {
+        std::lock_guard<std::mutex> lock(orphan_mutex);
+        p[1] = reinterpret_cast<uint64_t>(orphan_list[p[0]]);
+        orphan_list[p[0]] = p;
+        has_orphan[p[0]].store(true, std::memory_order_relaxed);
+    }
+}
+
+void set_pool_enabled(bool enabled)
 {
-    using width_t = BitVector::width_t;
+    use_pool.store(enabled, std::memory_order_relaxed);
+}
 
-    const uint64_t *data;
-    uint64_t buf;
-    width_t buflen;
+bool pool_enabled()
+{
+    return use_pool.load(std::memory_order_relaxed);
+}
 
-public:
+// Bit-range copy kernels
+//
+// A kernel copies n whole blocks to "to" from the bit stream starting at bit
+// "shift" (1..63) of "from", reading no more than nsrc source blocks.
 
-    BitsReader(const uint64_t *data)
-        : data(data), buf(0), buflen(0) {}
+namespace {
 
-    uint64_t read(width_t len)
-    {
-        uint64_t result = 0;
-        width_t offset = 0;
-        if (len > buflen) {
-          BitVectorUtils::setbits(result, buf, buflen, 0);
-          offset = buflen;
-          len -= buflen;
-          buf = *data++;
-          buflen = 64;
-        }
-        BitVectorUtils::setbits(result, buf, len, offset);
-        buf >>= len;
-        buflen -= len;
-        return result;
+void shift_copy_scalar(uint64_t *to, const uint64_t *from, uint64_t shift, size_t n, size_t nsrc)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint64_t value = from[i] >> shift;
+        if (i + 1 < nsrc)
+            value |= from[i + 1] << (64 - shift);
+        to[i] = value;
+    }
+}
+
+#ifdef BITVECTOR_X86_SIMD
+
+__attribute__((target("avx2")))
+void shift_copy_avx2(uint64_t *to, const uint64_t *from, uint64_t shift, size_t n, size_t nsrc)
+{
+    __m128i rshift = _mm_cvtsi64_si128(shift);
+    __m128i lshift = _mm_cvtsi64_si128(64 - shift);
+
+    size_t i = 0;
+    for (; i + 4 <= n && i + 4 < nsrc; i += 4) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)(from + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(from + i + 1));
+        __m256i value = _mm256_or_si256(_mm256_srl_epi64(lo, rshift), _mm256_sll_epi64(hi, lshift));
+        _mm256_storeu_si256((__m256i *)(to + i), value);
     }
+
+    shift_copy_scalar(to + i, from + i, shift, n - i, nsrc - i);
+}
+
+#endif
+
+#ifdef BITVECTOR_NEON_SIMD
+
+void shift_copy_neon(uint64_t *to, const uint64_t *from, uint64_t shift, size_t n, size_t nsrc)
+{
+    int64x2_t rshift = vdupq_n_s64(-int64_t(shift));
+    int64x2_t lshift = vdupq_n_s64(64 - int64_t(shift));
+
+    size_t i = 0;
+    for (; i + 2 <= n && i + 2 < nsrc; i += 2) {
+        uint64x2_t lo = vld1q_u64(from + i);
+        uint64x2_t hi = vld1q_u64(from + i + 1);
+        vst1q_u64(to + i, vorrq_u64(vshlq_u64(lo, rshift), vshlq_u64(hi, lshift)));
+    }
+
+    shift_copy_scalar(to + i, from + i, shift, n - i, nsrc - i);
+}
+
+#endif
+
+std::vector<CopyKernel> detect_copy_kernels()
+{
+    std::vector<CopyKernel> kernels;
+#ifdef BITVECTOR_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back({"avx2", shift_copy_avx2});
+#endif
+#ifdef BITVECTOR_NEON_SIMD
+    kernels.push_back({"neon", shift_copy_neon});
+#endif
+    kernels.push_back({"scalar", shift_copy_scalar});
+    return kernels;
+}
+
+const std::vector<CopyKernel> &available_kernels()
+{
+    static const std::vector<CopyKernel> kernels = detect_copy_kernels();
+    return kernels;
+}
+
+std::atomic<const CopyKernel *> cur_kernel(nullptr);
+
+const CopyKernel &get_kernel()
+{
+    const CopyKernel *kernel = cur_kernel.load(std::memory_order_relaxed);
+    if (!kernel) {
+        kernel = &available_kernels().front();
+        cur_kernel.store(kernel, std::memory_order_relaxed);
+    }
+    return *kernel;
+}
+
 };
 
+const std::vector<CopyKernel> &copy_kernels()
+{
+    return available_kernels();
+}
+
+void select_copy_kernel(const std::string &name)
+{
+    for (auto &kernel : available_kernels()) {
+        if (name == kernel.name) {
+            cur_kernel.store(&kernel, std::memory_order_relaxed);
+            return;
+        }
+    }
+    throw std::invalid_argument("copy kernel " + name + " not available");
+}
+
+const char *selected_copy_kernel()
+{
+    return get_kernel().name;
+}
+
+}; // namespace REMU::BitVectorUtils
+
+using namespace REMU;
+
 void BitVector::copy(width_t width, uint64_t *to_data, width_t to_offset, const uint64_t *from_data, width_t from_offset)
 {
+    using namespace BitVectorUtils;
+
     if (width == 0)
         return;
 
@@ -81,28 +303,89 @@ void BitVector::copy(width_t width, uint64_t *to_data, width_t to_offset, const
     //   to_offset + width |---|                           |----| to_offset
     //                 trailing piece                   leading piece
 
-    BitsReader reader(from_data);
-    reader.read(from_offset); // skip from_offset bits
-
     // copy the leading piece
 
     if (to_offset > 0) {
         width_t leading = std::min(64 - to_offset, width);
-        BitVectorUtils::setbits(*to_data++, reader.read(leading), leading,
-                                to_offset);
+        set_bits(to_data++, to_offset, leading, get_bits(from_data, from_offset, leading));
+        from_offset += leading;
+        from_data += from_offset / 64;
+        from_offset %= 64;
         width -= leading;
     }
 
     // copy the middle blocks
 
-    while (width >= 64) {
-        *to_data++ = reader.read(64);
-        width -= 64;
+    size_t n = width / 64;
+    if (n > 0) {
+        if (from_offset == 0)
+            std::copy_n(from_data, n, to_data);
+        else
+            get_kernel().func(to_data, from_data, from_offset, n, (from_offset + width + 63) / 64);
+        from_data += n;
+        to_data += n;
+        width %= 64;
     }
 
     // copy the trailing piece
 
-    if (width > 0) {
-      BitVectorUtils::setbits(*to_data, reader.read(width), width, 0);
+    if (width > 0)
+        set_bits(to_data, 0, width, get_bits(from_data, from_offset, width));
+}
+
+BitVector BitVector::from_hex(width_t width, const std::string &hex)
+{
+    BitVector result(width);
+    uint64_t *data = result.to_ptr();
+    size_t blks = result.blks();
+
+    // 16 digits per block, starting from the last digit
+    size_t ndigits = hex.size();
+    for (size_t i = 0; i < ndigits; i++) {
+        char c = hex[ndigits - 1 - i];
+        uint64_t digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            throw std::invalid_argument("invalid hex digit in " + hex);
+
+        if (i / 16 < blks)
+            data[i / 16] |= digit << (i % 16 * 4);
+    }
+
+    if (width % 64 != 0)
+        data[blks - 1] &= BitVectorUtils::bitmask<uint64_t>(width % 64);
+
+    return result;
+}
+
+BitVector BitVector::from_literal(const std::string &str)
+{
+    size_t pos = str.find('\'');
+    if (pos == std::string::npos)
+        return BitVector(str);
+
+    if (pos == 0 || pos + 1 >= str.size())
+        throw std::invalid_argument("invalid bit vector literal " + str);
+
+    width_t width = std::stoull(str.substr(0, pos));
+    char base = str[pos + 1];
+    std::string digits = str.substr(pos + 2);
+
+    if (base == 'h' || base == 'H')
+        return from_hex(width, digits);
+
+    if (base == 'b' || base == 'B') {
+        if (digits.size() > width)
+            digits = digits.substr(digits.size() - width);
+        BitVector result(width);
+        result.setValue(0, BitVector(digits));
+        return result;
     }
+
+    throw std::invalid_argument("invalid bit vector literal " + str);
 }
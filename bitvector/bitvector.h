@@ -8,6 +8,7 @@
 #include <iomanip>
 #include <sstream>
 #include <stdexcept>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -22,8 +23,64 @@ template <typename T> constexpr T bitmask(size_t onecount) {
   return static_cast<T>(-(onecount != 0)) &
          (static_cast<T>(-1) >> (sizeof(T) * 8 - onecount));
 }
+
+// Get width (<= 64) bits starting from offset, spanning at most 2 blocks
+inline uint64_t get_bits(const uint64_t *data, uint64_t offset, uint64_t width) {
+  if (width == 0)
+    return 0;
+  const uint64_t *p = data + offset / 64;
+  uint64_t shift = offset % 64;
+  uint64_t value = p[0] >> shift;
+  if (shift + width > 64)
+    value |= p[1] << (64 - shift);
+  return value & bitmask<uint64_t>(width);
+}
+
+// Set width (<= 64) bits starting from offset, spanning at most 2 blocks
+inline void set_bits(uint64_t *data, uint64_t offset, uint64_t width, uint64_t value) {
+  if (width == 0)
+    return;
+  uint64_t *p = data + offset / 64;
+  uint64_t shift = offset % 64;
+  value &= bitmask<uint64_t>(width);
+  uint64_t mask = bitmask<uint64_t>(width) << shift;
+  p[0] = (p[0] & ~mask) | (value << shift);
+  if (shift + width > 64) {
+    uint64_t mask1 = bitmask<uint64_t>(shift + width - 64);
+    p[1] = (p[1] & ~mask1) | (value >> (64 - shift));
+  }
+}
+
+// Storage of vectors wider than the inline storage
+//
+// Blocks come from new[] unless the pool is enabled, in which case blocks of
+// up to pool_max_blks are carved from large chunks and recycled through
+// per-thread free lists, which are taken over by other threads when a thread
+// exits. Pooled memory is never returned to the system, so
+// the pool suits processes holding many wide vectors (e.g. loaded
+// checkpoints). Enabling or disabling the pool at any time is safe, since
+// each allocation records where it comes from.
+constexpr size_t pool_max_blks = 64;
+uint64_t *alloc_blocks(size_t blks);
+void free_blocks(uint64_t *data);
+void set_pool_enabled(bool enabled);
+bool pool_enabled();
+
+// Kernels of BitVector::copy for unaligned sources
+//
+// The best kernel supported by the CPU is selected on first use. Others may
+// be selected by name, e.g. for testing.
+struct CopyKernel {
+  const char *name;
+  void (*func)(uint64_t *to, const uint64_t *from, uint64_t shift, size_t n, size_t nsrc);
+};
+const std::vector<CopyKernel> &copy_kernels();
+void select_copy_kernel(const std::string &name);
+const char *selected_copy_kernel();
 } // namespace BitVectorUtils
 
+class BitVectorView;
+
 class BitVector
 {
 
@@ -33,18 +90,23 @@ public:
 
 private:
 
+    // Vectors up to this width are stored inline without heap allocation
+    static constexpr width_t inline_width = 128;
+
     // The width of the vector, in bits
     width_t width_;
 
     union data_or_value {
-        uint64_t *data; // If width > 64
-        uint64_t value; // Otherwise
+        uint64_t *data;                         // If width > inline_width
+        uint64_t value[inline_width / 64];      // Otherwise
     } u;
 
-    bool use_ptr() const { return width_ > 64; }
+    bool use_ptr() const { return width_ > inline_width; }
 
     static void copy(width_t width, uint64_t *to_data, width_t to_offset, const uint64_t *from_data, width_t from_offset);
 
+    friend class BitVectorView;
+
     friend void swap(BitVector &first, BitVector &second) noexcept
     {
         std::swap(first.width_, second.width_);
@@ -53,8 +115,8 @@ private:
 
 public:
 
-    uint64_t *to_ptr() { return use_ptr() ? u.data : &u.value; }
-    const uint64_t *to_ptr() const { return use_ptr() ? u.data : &u.value; }
+    uint64_t *to_ptr() { return use_ptr() ? u.data : u.value; }
+    const uint64_t *to_ptr() const { return use_ptr() ? u.data : u.value; }
     size_t blks() const { return (width_ + 63) / 64; }
 
     width_t width() const { return width_; }
@@ -126,10 +188,11 @@ public:
     // This sets all bits to 0
     void clear()
     {
+        // Inline storage is cleared entirely, so that a 0-wide vector reads as 0
         if (use_ptr())
             std::fill_n(u.data, blks(), 0);
         else
-            u.value = 0;
+            std::fill_n(u.value, inline_width / 64, 0);
     }
 
     // This gets the specified bit in boolean value
@@ -155,13 +218,34 @@ public:
             ref &= ~bit;
     }
 
+    // This gets the width (<= 64) bits starting from offset as an integer
+    uint64_t getWord(width_t offset, width_t width) const
+    {
+        if (width > 64 || offset + width > width_)
+            throw std::out_of_range("selection out of range");
+
+        return BitVectorUtils::get_bits(to_ptr(), offset, width);
+    }
+
+    // This sets the width (<= 64) bits starting from offset to value
+    void setWord(width_t offset, width_t width, uint64_t value)
+    {
+        if (width > 64 || offset + width > width_)
+            throw std::out_of_range("selection out of range");
+
+        BitVectorUtils::set_bits(to_ptr(), offset, width, value);
+    }
+
     // This gets the width bits starting from offset to data array, and return data itself
     uint64_t *getValue(width_t offset, width_t width, uint64_t *data) const
     {
         if (offset + width > width_)
             throw std::out_of_range("selection out of range");
 
-        copy(width, data, 0, to_ptr(), offset);
+        if (width <= 64)
+            BitVectorUtils::set_bits(data, 0, width, BitVectorUtils::get_bits(to_ptr(), offset, width));
+        else
+            copy(width, data, 0, to_ptr(), offset);
 
         return data;
     }
@@ -175,22 +259,25 @@ public:
         return result;
     }
 
+    // This gets a view of the width bits starting from offset without copying
+    BitVectorView view(width_t offset, width_t width) const;
+
     // This sets the width bits starting from offset to data array
     void setValue(width_t offset, width_t width, const uint64_t *data)
     {
         if (offset + width > width_)
             throw std::out_of_range("selection out of range");
 
-        copy(width, to_ptr(), offset, data, 0);
+        if (width <= 64)
+            BitVectorUtils::set_bits(to_ptr(), offset, width, BitVectorUtils::get_bits(data, 0, width));
+        else
+            copy(width, to_ptr(), offset, data, 0);
     }
 
     // This sets the width bits starting from offset to value
     void setValue(width_t offset, width_t width, uint64_t value)
     {
-        if (width > 64)
-            throw std::out_of_range("selection out of range");
-
-        setValue(offset, width, &value);
+        setWord(offset, width, value);
     }
 
     // This sets the bits starting from offset to value
@@ -199,6 +286,9 @@ public:
         setValue(offset, value.width_, value.to_ptr());
     }
 
+    // This sets the bits starting from offset to the viewed bits
+    void setValue(width_t offset, const BitVectorView &value);
+
     // This constructs an empty 0-wide BitVector
     BitVector() : BitVector(0) {}
 
@@ -206,7 +296,7 @@ public:
     explicit BitVector(width_t width) : width_(width)
     {
         if (use_ptr()) {
-            u.data = new uint64_t[blks()];
+            u.data = BitVectorUtils::alloc_blocks(blks());
         }
         clear();
     }
@@ -227,10 +317,24 @@ public:
     // This constructs a BitVector with a bit string which consists of 0 and 1
     BitVector(const std::string &bits) : BitVector(bits.size())
     {
+        uint64_t *data = to_ptr();
         for (size_t i = 0 ; i < width_; i++)
-            setBit(i, bits.at(width_ - i - 1) == '1');
+            if (bits[width_ - i - 1] == '1')
+                data[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    // This constructs a BitVector with a hex string, whose higher bits beyond width are ignored
+    static BitVector from_hex(width_t width, const std::string &hex);
+
+    // This returns the bits in the form of <width>'h<hex>
+    std::string to_literal() const
+    {
+        return std::to_string(width_) + "'h" + hex();
     }
 
+    // This parses <width>'h<hex>, <width>'b<bin> or a plain bit string
+    static BitVector from_literal(const std::string &str);
+
     BitVector(const BitVector &other) : BitVector(other.width_, other.to_ptr(), other.blks()) {}
 
     BitVector(BitVector &&other) noexcept : BitVector()
@@ -241,7 +345,7 @@ public:
     ~BitVector()
     {
         if (use_ptr())
-            delete[] u.data;
+            BitVectorUtils::free_blocks(u.data);
     }
 
     BitVector &operator=(const BitVector &other)
@@ -275,33 +379,124 @@ public:
     }
 
     void rand() {
-      if (use_ptr()) {
-        for (size_t i = 0; i < blks(); i++) {
-          u.data[i] = BitVectorUtils::uint64_rand();
-        }
-        u.data[blks() - 1] &= BitVectorUtils::bitmask<uint64_t>(width() % 64);
-      } else {
-        u.value = BitVectorUtils::uint64_rand() &
-                  BitVectorUtils::bitmask<uint64_t>(width() % 64);
+      if (width_ == 0)
+        return;
+      uint64_t *data = to_ptr();
+      for (size_t i = 0; i < blks(); i++) {
+        data[i] = BitVectorUtils::uint64_rand();
       }
+      if (width() % 64 != 0)
+        data[blks() - 1] &= BitVectorUtils::bitmask<uint64_t>(width() % 64);
     }
 
-    // cereal serialization functions
+};
+
+// Read-only view of a bit range, like std::span
+//
+// The view does not own the data, so it must not outlive the BitVector it is
+// taken from, nor be used after the BitVector is resized or reassigned.
+
+class BitVectorView
+{
+
+public:
+
+    using width_t = BitVector::width_t;
+
+private:
+
+    const uint64_t *data_;
+    width_t offset_;
+    width_t width_;
+
+public:
 
-    template<class Archive>
-    std::string save_minimal(Archive const &) const
+    const uint64_t *data() const { return data_; }
+    width_t offset() const { return offset_; }
+    width_t width() const { return width_; }
+
+    bool getBit(width_t offset) const
     {
-        return bin();
+        if (offset >= width_)
+            throw std::out_of_range("offset out of range");
+
+        offset += offset_;
+        return (data_[offset / 64] >> (offset % 64)) & 1;
     }
 
-    template<class Archive>
-    void load_minimal(Archive const &, std::string const &str)
+    uint64_t getWord(width_t offset, width_t width) const
     {
-        *this = str;
+        if (width > 64 || offset + width > width_)
+            throw std::out_of_range("selection out of range");
+
+        return BitVectorUtils::get_bits(data_, offset_ + offset, width);
     }
 
+    BitVectorView view(width_t offset, width_t width) const
+    {
+        if (offset + width > width_)
+            throw std::out_of_range("selection out of range");
+
+        return BitVectorView(data_, offset_ + offset, width);
+    }
+
+    // Copy the viewed bits to a new BitVector
+    BitVector to_bitvector() const
+    {
+        BitVector result(width_);
+        copy_to(result.to_ptr(), 0);
+        return result;
+    }
+
+    // Copy the viewed bits to data array starting from offset
+    void copy_to(uint64_t *data, width_t offset) const
+    {
+        if (width_ <= 64)
+            BitVectorUtils::set_bits(data, offset, width_, BitVectorUtils::get_bits(data_, offset_, width_));
+        else
+            BitVector::copy(width_, data, offset, data_, offset_);
+    }
+
+    bool operator==(const BitVectorView &other) const
+    {
+        if (width_ != other.width_)
+            return false;
+
+        for (width_t i = 0; i < width_; i += 64) {
+            width_t n = std::min<width_t>(64, width_ - i);
+            if (getWord(i, n) != other.getWord(i, n))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool operator!=(const BitVectorView &other) const { return !(*this == other); }
+
+    BitVectorView(const uint64_t *data, width_t offset, width_t width) :
+        data_(data), offset_(offset), width_(width) {}
+
+    BitVectorView(const BitVector &value) :
+        data_(value.to_ptr()), offset_(0), width_(value.width()) {}
+
 };
 
+inline BitVectorView BitVector::view(width_t offset, width_t width) const
+{
+    if (offset + width > width_)
+        throw std::out_of_range("selection out of range");
+
+    return BitVectorView(to_ptr(), offset, width);
+}
+
+inline void BitVector::setValue(width_t offset, const BitVectorView &value)
+{
+    if (offset + value.width() > width_)
+        throw std::out_of_range("selection out of range");
+
+    value.copy_to(to_ptr(), offset);
+}
+
 class BitVectorArray
 {
 
@@ -348,6 +543,14 @@ public:
         return data.getValue(index * width_, width_);
     }
 
+    BitVectorView view(depth_t index) const
+    {
+        if (index < start_offset_ || index >= start_offset_ + depth_)
+            throw std::out_of_range("index out of range");
+
+        return data.view(index * width_, width_);
+    }
+
     void set(depth_t index, const BitVector &value)
     {
         if (value.width() != width_)
@@ -359,8 +562,21 @@ public:
         data.setValue(index * width_, value);
     }
 
+    void set(depth_t index, const BitVectorView &value)
+    {
+        if (value.width() != width_)
+            throw std::invalid_argument("value width mismatch");
+
+        if (index < start_offset_ || index >= start_offset_ + depth_)
+            throw std::out_of_range("index out of range");
+
+        data.setValue(index * width_, value);
+    }
+
     BitVector get_flattened_data() const { return data; }
 
+    BitVectorView flattened_view() const { return data.view(0, data.width()); }
+
     void set_flattened_data(const BitVector &value)
     {
         if (value.width() != width_ * depth_)
@@ -369,6 +585,14 @@ public:
         data = value;
     }
 
+    void set_flattened_data(const BitVectorView &value)
+    {
+        if (value.width() != width_ * depth_)
+            throw std::invalid_argument("value width mismatch");
+
+        data.setValue(0, value);
+    }
+
     BitVectorArray() : BitVectorArray(0, 0) {}
 
     BitVectorArray(width_t width, depth_t depth, depth_t start_offset = 0) :
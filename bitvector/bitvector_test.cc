@@ -419,8 +419,192 @@ bool test_bitvector_hex()
     BitVector c(129, {0x1, 0x0, 0x1});
     EXPECT(c.hex(), "100000000000000000000000000000001");
 
+    // all digits of the width are printed
     BitVector d(64, 0x123456789abcdef);
-    EXPECT(d.hex(), "123456789abcdef");
+    EXPECT(d.hex(), "0123456789abcdef");
+
+    return true;
+}
+
+bool test_bitvector_literal()
+{
+    BitVector a(129, {0x0123456789abcdef, 0xfedcba9876543210, 0x1});
+    EXPECT(a.to_literal(), "129'h1fedcba98765432100123456789abcdef");
+    EXPECT(BitVector::from_literal(a.to_literal()) == a, true);
+
+    BitVector b = BitVector::from_hex(12, "FaBc");
+    EXPECT(b.width(), 12);
+    EXPECT(b, 0xabc);
+
+    BitVector c = BitVector::from_literal("8'b101");
+    EXPECT(c.width(), 8);
+    EXPECT(c, 0x5);
+
+    // plain bit strings in older files
+    BitVector d = BitVector::from_literal("1100");
+    EXPECT(d.width(), 4);
+    EXPECT(d, 0xc);
+
+    BitVector e = BitVector::from_literal("0'h");
+    EXPECT(e.width(), 0);
+
+    bool thrown = false;
+    try {
+        BitVector::from_literal("8'hxz");
+    }
+    catch (std::invalid_argument &) {
+        thrown = true;
+    }
+    EXPECT(thrown, true);
+
+    return true;
+}
+
+bool test_bitvector_word()
+{
+    BitVector a(160, {0x8765432112345678, 0xaabbccddeeff0011, 0x55667788});
+    EXPECT(a.getWord(0, 64), 0x8765432112345678);
+    EXPECT(a.getWord(4, 8), 0x67);
+    EXPECT(a.getWord(32, 64), 0xeeff001187654321);
+    EXPECT(a.getWord(60, 8), 0x18);
+    EXPECT(a.getWord(128, 32), 0x55667788);
+    EXPECT(a.getWord(100, 0), 0);
+
+    a.setWord(60, 8, 0xa5);
+    EXPECT(a.getWord(56, 16), 0x1a57);
+    a.setWord(96, 64, 0x0123456789abcdef);
+    EXPECT(a.getWord(64, 32), 0xeeff001a);
+    EXPECT(a.getWord(96, 64), 0x0123456789abcdef);
+    a.setWord(0, 4, 0xff);
+    EXPECT(a.getWord(0, 8), 0x7f);
+
+    uint64_t data[2] = {~0ul, ~0ul};
+    a.getValue(28, 8, data);
+    EXPECT(data[0], 0xffffffffffffff11);
+
+    return true;
+}
+
+bool test_bitvector_view()
+{
+    BitVector a(200, {0x8765432112345678, 0xaabbccddeeff0011, 0x5566778899aabbcc, 0xff});
+    auto v = a.view(36, 130);
+    EXPECT(v.width(), 130);
+    EXPECT(v.getWord(0, 32), 0x18765432);
+    EXPECT(v.getBit(1), true);
+    EXPECT(v.to_bitvector() == a.getValue(36, 130), true);
+    EXPECT(v.view(4, 70).to_bitvector() == a.getValue(40, 70), true);
+
+    BitVector b(256);
+    b.setValue(7, v);
+    EXPECT(b.getValue(7, 130) == a.getValue(36, 130), true);
+    EXPECT(b.getWord(0, 7), 0);
+    EXPECT(b.getWord(137, 64), 0);
+    EXPECT(b.view(7, 130) == v, true);
+    EXPECT(b.view(8, 130) == v, false);
+
+    BitVectorArray array(33, 8);
+    array.set(3, a.view(1, 33));
+    EXPECT(array.view(3).to_bitvector() == a.getValue(1, 33), true);
+
+    return true;
+}
+
+bool test_bitvector_storage()
+{
+    // inline storage
+    BitVector a(128, {0x1111, 0x2222});
+    BitVector a1(a);
+    BitVector a2(std::move(a1));
+    EXPECT(a2 == a, true);
+    EXPECT(a2.getWord(64, 64), 0x2222);
+    a1 = a2;
+    EXPECT(a1 == a, true);
+
+    // allocated storage, switching the pool on and off while vectors are alive
+    BitVector b(129, {0x1, 0x2, 0x1});
+    BitVectorUtils::set_pool_enabled(true);
+    std::vector<BitVector> vs;
+    for (int i = 0; i < 1000; i++)
+        vs.push_back(BitVector(300 + i * 5, {uint64_t(i), 0, 0, 0, uint64_t(i)}));
+    BitVector c(b);
+    BitVectorUtils::set_pool_enabled(false);
+    for (int i = 0; i < 1000; i += 2)
+        vs[i] = BitVector(64, i);
+    BitVectorUtils::set_pool_enabled(true);
+    for (int i = 0; i < 1000; i += 2)
+        vs[i] = BitVector(300 + i * 5, {uint64_t(i), 0, 0, 0, uint64_t(i)});
+    EXPECT(c == b, true);
+    BitVectorUtils::set_pool_enabled(false);
+
+    for (int i = 0; i < 1000; i++) {
+        if (vs[i].width() != 300 + uint64_t(i) * 5 || vs[i].getWord(0, 64) != uint64_t(i) ||
+                vs[i].getWord(256, 32) != uint64_t(i)) {
+            std::cout << "Pooled vector " << i << " corrupted" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Bit-by-bit reference of BitVector::setValue
+void reference_copy(std::vector<uint64_t> &to, uint64_t to_offset,
+    const std::vector<uint64_t> &from, uint64_t from_offset, uint64_t width)
+{
+    for (uint64_t i = 0; i < width; i++) {
+        uint64_t f = from_offset + i, t = to_offset + i;
+        uint64_t bit = (from[f / 64] >> (f % 64)) & 1;
+        to[t / 64] = (to[t / 64] & ~(uint64_t(1) << (t % 64))) | (bit << (t % 64));
+    }
+}
+
+bool test_bitvector_copy_kernels()
+{
+    const uint64_t src_width = 4096, dst_width = 4096;
+
+    for (auto &kernel : BitVectorUtils::copy_kernels()) {
+        std::cout << "Testing copy kernel " << kernel.name << std::endl;
+        BitVectorUtils::select_copy_kernel(kernel.name);
+
+        for (int iter = 0; iter < 2000; iter++) {
+            BitVector src(src_width), dst(dst_width);
+            src.rand();
+            dst.rand();
+
+            uint64_t width = BitVectorUtils::size_rand() % (src_width + 1);
+            if (iter % 4 == 0)
+                width %= 300;
+            uint64_t from = BitVectorUtils::size_rand() % (src_width - width + 1);
+            uint64_t to = BitVectorUtils::size_rand() % (dst_width - width + 1);
+
+            std::vector<uint64_t> expected(dst.to_ptr(), dst.to_ptr() + dst.blks());
+            std::vector<uint64_t> src_data(src.to_ptr(), src.to_ptr() + src.blks());
+            reference_copy(expected, to, src_data, from, width);
+
+            dst.setValue(to, src.view(from, width));
+
+            if (!std::equal(expected.begin(), expected.end(), dst.to_ptr())) {
+                std::cout << "Kernel " << kernel.name << " mismatch: width " << std::dec << width
+                    << ", from " << from << ", to " << to << std::endl;
+                return false;
+            }
+
+            // The source must only be read within the range, so copy from a
+            // buffer ending right after the selected bits
+            uint64_t nblks = (from % 64 + width + 63) / 64;
+            std::vector<uint64_t> tight(src_data.begin() + from / 64, src_data.begin() + from / 64 + nblks);
+            std::vector<uint64_t> out(dst.to_ptr(), dst.to_ptr() + dst.blks());
+            dst.setValue(to, BitVectorView(tight.data(), from % 64, width));
+            if (!std::equal(expected.begin(), expected.end(), dst.to_ptr())) {
+                std::cout << "Kernel " << kernel.name << " mismatch on tight source" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    BitVectorUtils::select_copy_kernel(BitVectorUtils::copy_kernels().front().name);
+    EXPECT(std::string(BitVectorUtils::selected_copy_kernel()), BitVectorUtils::copy_kernels().front().name);
 
     return true;
 }
@@ -433,6 +617,27 @@ bool test_bitvectorarray()
     EXPECT(array.get(0), 0);
     EXPECT(array.get(1), 1);
     EXPECT(array.get(2) == BitVector(64, 2), true);
+
+    // flattened data of elements not aligned to blocks, placed at an
+    // unaligned offset as in a scan chain image
+    BitVectorArray src(37, 50);
+    for (int i=0; i<50; i++)
+        src.set(i, BitVector(37, 0x1f00000001 + i * 0x123456789));
+
+    BitVector image(13 + 37 * 50 + 7);
+    image.setValue(13, src.flattened_view());
+    EXPECT(image.getValue(0, 13), 0);
+    EXPECT(image.getValue(13 + 37 * 50, 7), 0);
+
+    BitVectorArray dst(37, 50);
+    dst.set_flattened_data(image.view(13, 37 * 50));
+    for (int i=0; i<50; i++)
+        EXPECT(dst.get(i) == src.get(i), true);
+    EXPECT(dst.get_flattened_data() == src.get_flattened_data(), true);
+
+    BitVectorArray dst2(37, 50);
+    dst2.set_flattened_data(src.get_flattened_data());
+    EXPECT(dst2.get(49) == src.get(49), true);
     return true;
 }
 
@@ -442,6 +647,11 @@ int main() {
     RUN(test_bitvector_get());
     RUN(test_bitvector_set());
     RUN(test_bitvector_bitmanip());
+    RUN(test_bitvector_word());
+    RUN(test_bitvector_view());
+    RUN(test_bitvector_storage());
+    RUN(test_bitvector_copy_kernels());
+    RUN(test_bitvector_literal());
     RUN(test_bitvector_hex());
     RUN(test_bitvectorarray());
     return 0;
@@ -5,19 +5,57 @@
 #include <set>
 #include <string>
 #include <fstream>
+#include <stdexcept>
+#include <algorithm>
 #include <filesystem>
 
 #include <cereal/types/map.hpp>
 #include <cereal/types/set.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/archives/json.hpp>
+#include <cereal/archives/portable_binary.hpp>
 
 #include "emu_utils.h"
+#include "delta_image.h"
+#include "compressed_image.h"
 
 #define NVP(name) cereal::make_nvp(#name, node.name)
 
 namespace cereal {
 
+// BitVectors are stored as <width>'h<hex> in text archives and as raw blocks
+// in binary archives. Plain bit strings from older checkpoints are still
+// accepted when loading.
+
+template<class Archive, traits::EnableIf<traits::is_text_archive<Archive>::value> = traits::sfinae>
+std::string save_minimal(Archive const &, REMU::BitVector const &node)
+{
+    return node.to_literal();
+}
+
+template<class Archive, traits::EnableIf<traits::is_text_archive<Archive>::value> = traits::sfinae>
+void load_minimal(Archive const &, REMU::BitVector &node, std::string const &str)
+{
+    node = REMU::BitVector::from_literal(str);
+}
+
+template<class Archive, traits::DisableIf<traits::is_text_archive<Archive>::value> = traits::sfinae>
+void save(Archive &archive, REMU::BitVector const &node)
+{
+    uint64_t width = node.width();
+    archive(width);
+    archive(binary_data(node.to_ptr(), node.blks() * sizeof(uint64_t)));
+}
+
+template<class Archive, traits::DisableIf<traits::is_text_archive<Archive>::value> = traits::sfinae>
+void load(Archive &archive, REMU::BitVector &node)
+{
+    uint64_t width;
+    archive(width);
+    node = REMU::BitVector(width);
+    archive(binary_data(node.to_ptr(), node.blks() * sizeof(uint64_t)));
+}
+
 template<class Archive>
 void serialize(Archive &archive, REMU::CheckpointManager &node)
 {
@@ -25,6 +63,19 @@ void serialize(Archive &archive, REMU::CheckpointManager &node)
         NVP(ticks),
         NVP(signal_trace)
     );
+
+    // formats are absent in checkpoints created before they were recorded
+    if constexpr (Archive::is_loading::value) {
+        try {
+            archive(NVP(formats));
+        }
+        catch (cereal::Exception &e) {
+            node.formats.clear();
+        }
+    }
+    else {
+        archive(NVP(formats));
+    }
 }
 
 }
@@ -33,6 +84,32 @@ namespace fs = std::filesystem;
 
 using namespace REMU;
 
+namespace {
+
+// Plain image file, which is complete once it is closed
+class RawImageOStream : public ImageOStream
+{
+    std::filebuf buf;
+
+public:
+
+    virtual bool finish() override
+    {
+        if (buf.is_open() && !buf.close())
+            setstate(std::ios::badbit);
+        return !fail();
+    }
+
+    RawImageOStream(const std::string &path)
+    {
+        rdbuf(&buf);
+        if (!buf.open(path, std::ios::out | std::ios::binary))
+            setstate(std::ios::failbit);
+    }
+};
+
+}; // namespace
+
 static size_t copy_stream(std::istream &in, std::ostream &out, size_t size, size_t buf_size = 0x100000)
 {
     size_t xferred = 0;
@@ -54,46 +131,132 @@ static size_t copy_stream(std::istream &in, std::ostream &out, size_t size, size
     return xferred;
 }
 
-std::ifstream CheckpointMem::read()
+static std::string get_tick_dir_name(uint64_t tick)
 {
-    return std::ifstream(mem_path, std::ios::binary);
+    char ckpt_name[32];
+    snprintf(ckpt_name, 32, "%020lu", tick);
+    return ckpt_name;
+}
+
+std::string CheckpointMem::get_image_path(CheckpointFormat format, uint64_t tick) const
+{
+    std::string path = fs::path(ckpt_root_path) / get_tick_dir_name(tick) / "mem" / name;
+
+    switch (format) {
+        case CheckpointFormat::Delta:       return path + ".delta";
+        case CheckpointFormat::Dedup:       return path + ".chunks";
+        case CheckpointFormat::Compressed:  return path + ".z";
+        default:                            return path;
+    }
+}
+
+DeltaPathResolver CheckpointMem::delta_path_resolver() const
+{
+    auto root = ckpt_root_path, mem_name = name;
+    return [root, mem_name](uint64_t tick) {
+        return (fs::path(root) / get_tick_dir_name(tick) / "mem" / mem_name).string() + ".delta";
+    };
+}
+
+CheckpointFormat CheckpointMem::detect_format() const
+{
+    if (is_delta_image(get_image_path(CheckpointFormat::Delta, tick)))
+        return CheckpointFormat::Delta;
+
+    if (is_chunk_manifest(get_image_path(CheckpointFormat::Dedup, tick)))
+        return CheckpointFormat::Dedup;
+
+    if (is_compressed_image(get_image_path(CheckpointFormat::Compressed, tick)))
+        return CheckpointFormat::Compressed;
+
+    return CheckpointFormat::Raw;
+}
+
+std::unique_ptr<std::istream> CheckpointMem::read()
+{
+    auto fmt = detect_format();
+    auto path = get_image_path(fmt, tick);
+
+    switch (fmt) {
+        case CheckpointFormat::Delta:
+            return std::make_unique<DeltaImageIStream>(path, delta_path_resolver());
+        case CheckpointFormat::Dedup:
+            return std::make_unique<ChunkImageIStream>(path, chunk_store->pack_path());
+        case CheckpointFormat::Compressed:
+            return std::make_unique<CompressedImageIStream>(path);
+        default:
+            return std::make_unique<std::ifstream>(path, std::ios::binary);
+    }
 }
 
-std::ofstream CheckpointMem::write()
+std::unique_ptr<ImageOStream> CheckpointMem::write()
 {
-    return std::ofstream(mem_path, std::ios::binary);
+    auto fmt = is_new ? format : detect_format();
+    auto path = get_image_path(fmt, tick);
+
+    // Remove stale images of other formats left by a truncated checkpoint
+    if (is_new) {
+        for (auto other : {CheckpointFormat::Raw, CheckpointFormat::Delta,
+                CheckpointFormat::Dedup, CheckpointFormat::Compressed})
+            if (other != fmt)
+                fs::remove(get_image_path(other, tick));
+    }
+
+    std::unique_ptr<ImageOStream> stream;
+    switch (fmt) {
+        case CheckpointFormat::Delta: {
+            auto base_path = base_tick.has_value() ? get_image_path(fmt, base_tick.value()) : "";
+            stream = std::make_unique<DeltaImageOStream>(path, tick, mem_size, base_path, !is_new,
+                delta_path_resolver());
+            break;
+        }
+        case CheckpointFormat::Dedup:
+            stream = std::make_unique<ChunkImageOStream>(path, mem_size, chunk_store);
+            break;
+        case CheckpointFormat::Compressed:
+            stream = std::make_unique<CompressedImageOStream>(path, mem_size);
+            break;
+        default:
+            stream = std::make_unique<RawImageOStream>(path);
+            break;
+    }
+
+    is_new = false;
+    return stream;
 }
 
 void CheckpointMem::load(std::string file)
 {
     std::ifstream in(file, std::ios::binary);
-    std::ofstream out(mem_path, std::ios::binary);
-    copy_stream(in, out, mem_size);
+    auto out = write();
+    copy_stream(in, *out, mem_size);
+    if (!out->finish())
+        throw std::runtime_error("failed to write memory image " + name);
 }
 
 void CheckpointMem::save(std::string file)
 {
-    std::ifstream in(mem_path, std::ios::binary);
+    auto in = read();
     std::ofstream out(file, std::ios::binary);
-    copy_stream(in, out, mem_size);
+    copy_stream(*in, out, mem_size);
 }
 
 void CheckpointMem::flush()
 {
+    if (detect_format() != CheckpointFormat::Raw)
+        return;
+
+    auto mem_path = get_image_path(CheckpointFormat::Raw, tick);
     if (!fs::exists(mem_path)) {
-        auto f = write();
-        f.close();
+        std::ofstream f(mem_path, std::ios::binary);
     }
     fs::resize_file(mem_path, mem_size);
 }
 
-std::string Checkpoint::get_mem_path(std::string name)
-{
-    return fs::path(ckpt_path) / "mem" / name;
-}
-
-Checkpoint::Checkpoint(const CheckpointInfo &info, const std::string &path)
-    : info(info), ckpt_path(path)
+Checkpoint::Checkpoint(const CheckpointInfo &info, const std::string &root, uint64_t tick,
+    bool is_new, CheckpointFormat format, std::optional<uint64_t> base_tick,
+    std::shared_ptr<ChunkStore> chunk_store)
+    : info(info), ckpt_path(fs::path(root) / get_tick_dir_name(tick))
 {
     // Create checkpoint directorires
 
@@ -105,21 +268,77 @@ Checkpoint::Checkpoint(const CheckpointInfo &info, const std::string &path)
     for (auto &x : info.axi_size_map) {
         if(x.second == 0)
             continue;
-        axi_mems.try_emplace(x.first, get_mem_path(x.first), x.second);
+        axi_mems.try_emplace(x.first, root, x.first, tick, x.second, is_new, format, base_tick,
+            chunk_store);
     }
 }
 
 void CheckpointManager::flush()
 {
-    std::ofstream f(fs::path(ckpt_root_path) / "data.json");
+    if (log_truncate.has_value()) {
+        trace_log.append_truncate(log_truncate.value());
+        log_truncate.reset();
+    }
+
+    uint64_t mark = log_mark;
+
+    for (auto it = ticks.lower_bound(log_mark); it != ticks.end(); ++it) {
+        if (deferred.count(*it))
+            continue;
+        trace_log.append_tick(*it);
+        mark = std::max(mark, *it);
+    }
+
+    for (auto it = formats.lower_bound(log_mark); it != formats.end(); ++it) {
+        if (deferred.count(it->first))
+            continue;
+        trace_log.append_format(it->first, static_cast<uint32_t>(it->second));
+    }
+
+    for (auto &trace : signal_trace) {
+        for (auto it = trace.second.lower_bound(log_mark); it != trace.second.end(); ++it) {
+            trace_log.append_value(trace.first, it->first, it->second);
+            mark = std::max(mark, it->first);
+        }
+    }
+
+    trace_log.sync();
+
+    // Entries after a deferred checkpoint are appended again once it is committed
+    if (!deferred.empty())
+        mark = std::min(mark, *deferred.begin());
+
+    // Entries at the mark are appended again on next flush as they may still change
+    log_mark = mark;
+}
+
+void CheckpointManager::discard(uint64_t tick)
+{
+    deferred.erase(tick);
+    ticks.erase(tick);
+    formats.erase(tick);
+}
+
+void CheckpointManager::export_metadata(const std::string &file)
+{
+    if (fs::path(file).extension() == ".bin") {
+        std::ofstream f(file, std::ios::binary);
+        cereal::PortableBinaryOutputArchive archive(f);
+        cereal::serialize(archive, *this);
+        return;
+    }
+
+    std::ofstream f(file);
     cereal::JSONOutputArchive archive(f);
     cereal::serialize(archive, *this);
 }
 
-void CheckpointManager::truncate(uint64_t tick)
+void CheckpointManager::erase_after(uint64_t tick)
 {
     auto it = ticks.upper_bound(tick);
     ticks.erase(it, ticks.end());
+    formats.erase(formats.upper_bound(tick), formats.end());
+    deferred.erase(deferred.upper_bound(tick), deferred.end());
 
     for (auto &trace : signal_trace) {
         auto it = trace.second.upper_bound(tick);
@@ -127,21 +346,75 @@ void CheckpointManager::truncate(uint64_t tick)
     }
 }
 
-Checkpoint CheckpointManager::open(uint64_t tick)
+void CheckpointManager::truncate(uint64_t tick)
 {
-    ticks.insert(tick);
+    erase_after(tick);
 
-    char ckpt_name[32];
-    snprintf(ckpt_name, 32, "%020lu", tick);
+    log_truncate = std::min(log_truncate.value_or(tick), tick);
+    log_mark = std::min(log_mark, tick);
+}
+
+void CheckpointManager::load_trace_log()
+{
+    trace_log.read([this](const TraceLog::Record &record) {
+        switch (record.type) {
+            case TraceLog::Tick:
+                ticks.insert(record.tick);
+                break;
+            case TraceLog::Format:
+                formats[record.tick] = static_cast<CheckpointFormat>(record.format);
+                break;
+            case TraceLog::Value:
+                signal_trace[*record.signal][record.tick] = record.value;
+                break;
+            case TraceLog::Truncate:
+                erase_after(record.tick);
+                break;
+            default:
+                break;
+        }
+    });
 
-    auto ckpt_path = fs::path(ckpt_root_path) / ckpt_name;
-    fs::create_directories(ckpt_path);
+    log_mark = last_tick();
+    for (auto &trace : signal_trace)
+        if (!trace.second.empty())
+            log_mark = std::max(log_mark, trace.second.rbegin()->first);
+}
 
-    return Checkpoint(info, ckpt_path);
+Checkpoint CheckpointManager::open(uint64_t tick)
+{
+    bool is_new = !has_tick(tick);
+
+    // The latest checkpoint before a new one is the base of delta images
+    std::optional<uint64_t> base_tick;
+    if (is_new) {
+        auto it = ticks.lower_bound(tick);
+        if (it != ticks.begin())
+            base_tick = *--it;
+    }
+
+    ticks.insert(tick);
+    if (is_new)
+        formats[tick] = format;
+
+    // Signal traces may be changed after the loaded checkpoint in replay,
+    // so they are appended to the log again when a checkpoint is created
+    if (is_new) {
+        log_mark = std::min(log_mark, tick);
+        if (loaded_tick.has_value())
+            log_mark = std::min(log_mark, loaded_tick.value());
+    }
+    else {
+        loaded_tick = tick;
+    }
+
+    return Checkpoint(info, ckpt_root_path, tick, is_new, format, base_tick, chunk_store);
 }
 
 CheckpointManager::CheckpointManager(const SysInfo &sysinfo, const std::string &path)
-    : ckpt_root_path(path)
+    : chunk_store(std::make_shared<ChunkStore>(path)),
+    trace_log(fs::path(path) / "trace.log"),
+    ckpt_root_path(path)
 {
     // Initialize checkpoint info
 
@@ -161,10 +434,16 @@ CheckpointManager::CheckpointManager(const SysInfo &sysinfo, const std::string &
 
     // Load or Initialize serializable data
 
-    std::ifstream f(fs::path(ckpt_root_path) / "data.json");
-    if (!f.fail()) {
-        cereal::JSONInputArchive archive(f);
-        cereal::serialize(archive, *this);
+    if (trace_log.exists()) {
+        load_trace_log();
+    }
+    else {
+        // Checkpoints created before the trace log is introduced are converted on next flush
+        std::ifstream f(fs::path(ckpt_root_path) / "data.json");
+        if (!f.fail()) {
+            cereal::JSONInputArchive archive(f);
+            cereal::serialize(archive, *this);
+        }
     }
 
     for (auto &x : info.input_signals) {
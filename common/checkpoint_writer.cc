@@ -0,0 +1,122 @@
+#include "checkpoint_writer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace REMU;
+
+CheckpointWriter::CheckpointWriter(size_t max_pending) :
+    busy(false), stop(false), max_pending(max_pending)
+{
+    thread = std::thread(&CheckpointWriter::worker, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    drain();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+
+    thread.join();
+}
+
+void CheckpointWriter::worker()
+{
+    while (true) {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this]() { return stop || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+        }
+
+        std::exception_ptr error;
+
+        try {
+            for (auto &x : job.images) {
+                auto stream = job.ckpt->axi_mems.at(x.first).write();
+                stream->write(x.second->data(), x.second->size());
+                if (!stream->finish())
+                    throw std::runtime_error("failed to write memory image " + x.first);
+            }
+            job.ckpt.reset();
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back({job.tick, error});
+            if (max_pending != 0) {
+                for (auto &x : job.images)
+                    free_buffers.push_back(std::move(x.second));
+            }
+            busy = false;
+        }
+        cond.notify_all();
+    }
+}
+
+void CheckpointWriter::set_max_pending(size_t max)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    max_pending = max;
+    if (max_pending == 0)
+        free_buffers.clear();
+    cond.notify_all();
+}
+
+void CheckpointWriter::wait_slot()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this]() { return jobs.size() + busy < std::max<size_t>(max_pending, 1); });
+}
+
+void CheckpointWriter::drain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this]() { return jobs.empty() && !busy; });
+}
+
+std::vector<CheckpointWriter::Result> CheckpointWriter::take_results()
+{
+    std::vector<Result> res;
+    std::lock_guard<std::mutex> lock(mutex);
+    res.swap(results);
+    return res;
+}
+
+std::unique_ptr<HostBuffer> CheckpointWriter::alloc_buffer(size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = free_buffers.begin(); it != free_buffers.end(); ++it) {
+            if ((*it)->size() == size) {
+                auto buffer = std::move(*it);
+                free_buffers.erase(it);
+                return buffer;
+            }
+        }
+    }
+
+    return std::make_unique<HostBuffer>(size);
+}
+
+void CheckpointWriter::submit(uint64_t tick, std::unique_ptr<Checkpoint> ckpt, Images &&images)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({tick, std::move(ckpt), std::move(images)});
+    }
+    cond.notify_all();
+}
@@ -0,0 +1,232 @@
+#include "chunk_store.h"
+
+#include <cstring>
+#include <filesystem>
+
+#include "emu_utils.h"
+
+namespace fs = std::filesystem;
+
+using namespace REMU;
+
+namespace {
+
+constexpr char manifest_magic[8] = {'R', 'E', 'M', 'U', 'C', 'H', 'K', '1'};
+
+bool read_manifest(const std::string &path, ChunkManifestHeader &header, std::vector<ChunkRef> &manifest)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (f.fail())
+        return false;
+
+    f.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (f.gcount() != sizeof(header) || memcmp(header.magic, manifest_magic, sizeof(manifest_magic)) != 0)
+        return false;
+
+    if (header.chunk_size == 0 ||
+            header.chunk_count != (header.image_size + header.chunk_size - 1) / header.chunk_size)
+        return false;
+
+    manifest.resize(header.chunk_count);
+    f.read(reinterpret_cast<char *>(manifest.data()), manifest.size() * sizeof(ChunkRef));
+    return f.gcount() == manifest.size() * sizeof(ChunkRef);
+}
+
+}; // namespace
+
+bool REMU::is_chunk_manifest(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (f.fail())
+        return false;
+
+    char magic[sizeof(manifest_magic)];
+    f.read(magic, sizeof(magic));
+    return f.gcount() == sizeof(magic) && memcmp(magic, manifest_magic, sizeof(magic)) == 0;
+}
+
+ChunkStore::ChunkStore(const std::string &root) :
+    store_path(fs::path(root) / "chunks"), opened(false), pack_end(0) {}
+
+std::string ChunkStore::pack_path() const
+{
+    return fs::path(store_path) / "pack";
+}
+
+std::string ChunkStore::index_path() const
+{
+    return fs::path(store_path) / "index";
+}
+
+void ChunkStore::open()
+{
+    // The store is opened on first write, so that readers do not pay for loading the index
+
+    fs::create_directories(store_path);
+
+    if (fs::exists(pack_path()))
+        pack_end = fs::file_size(pack_path());
+
+    std::ifstream f(index_path(), std::ios::binary);
+    ChunkRef ref;
+    while (f.read(reinterpret_cast<char *>(&ref), sizeof(ref))) {
+        // Ignore chunks lost in an interrupted write
+        if (ref.offset + ref.len <= pack_end)
+            index[ref.key] = ref;
+    }
+
+    pack.open(pack_path(), std::ios::binary | std::ios::app);
+    index_file.open(index_path(), std::ios::binary | std::ios::app);
+
+    opened = true;
+}
+
+bool ChunkStore::put(const char *data, size_t len, ChunkRef &ref)
+{
+    ref = {{hash_bytes(data, len, 0), hash_bytes(data, len, 1)}, 0, len};
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!opened)
+        open();
+
+    // Chunks stored after a failed write may be lost, so the store is
+    // unusable once either file fails
+    if (!pack || !index_file)
+        return false;
+
+    auto it = index.find(ref.key);
+    bool collided = it != index.end();
+    if (collided && it->second.len == len && stored_equal(it->second, data, len)) {
+        ref = it->second;
+        return true;
+    }
+
+    ref.offset = pack_end;
+    if (!pack.write(data, len))
+        return false;
+    pack_end += len;
+
+    // A colliding chunk is stored but not indexed, so that the indexed one
+    // keeps being shared
+    if (!collided) {
+        if (!index_file.write(reinterpret_cast<const char *>(&ref), sizeof(ref)))
+            return false;
+        index[ref.key] = ref;
+    }
+
+    return true;
+}
+
+bool ChunkStore::stored_equal(const ChunkRef &ref, const char *data, size_t len)
+{
+    // Chunks may still be buffered in the pack stream
+    pack.flush();
+
+    if (!pack_reader.is_open())
+        pack_reader.open(pack_path(), std::ios::binary);
+
+    compare_buf.resize(len);
+    pack_reader.clear();
+    pack_reader.seekg(ref.offset);
+    pack_reader.read(compare_buf.data(), len);
+
+    return pack_reader.gcount() == std::streamsize(len) && memcmp(compare_buf.data(), data, len) == 0;
+}
+
+bool ChunkStore::sync()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!opened)
+        return true;
+
+    pack.flush();
+    index_file.flush();
+    return pack && index_file;
+}
+
+ChunkImageWriteBuf::ChunkImageWriteBuf(const std::string &path, uint64_t image_size,
+    std::shared_ptr<ChunkStore> store) :
+    PagedWriteBuf(image_size, CHUNK_SIZE), store(store), path(path)
+{
+    // Chunks which are never written are zero chunks
+    manifest.assign(page_count, {{0, 0}, 0, 0});
+}
+
+ChunkImageWriteBuf::~ChunkImageWriteBuf()
+{
+    finish();
+}
+
+bool ChunkImageWriteBuf::finish_image()
+{
+    // Chunks must be stored & visible before the manifest refers to them
+    if (has_failed() || !store->sync())
+        return false;
+
+    ChunkManifestHeader header;
+    memcpy(header.magic, manifest_magic, sizeof(manifest_magic));
+    header.image_size = image_size;
+    header.chunk_size = page_size;
+    header.chunk_count = page_count;
+
+    std::ofstream f(path, std::ios::binary);
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char *>(manifest.data()), manifest.size() * sizeof(ChunkRef));
+    f.close();
+
+    if (f.fail()) {
+        // Do not leave a truncated manifest behind
+        fs::remove(path);
+        return false;
+    }
+
+    return true;
+}
+
+int ChunkImageWriteBuf::sync()
+{
+    if (!store->sync())
+        return -1;
+
+    return PagedWriteBuf::sync();
+}
+
+bool ChunkImageWriteBuf::commit_page(uint64_t index, const char *data, size_t len)
+{
+    if (is_zero_page(data, len)) {
+        manifest[index] = {{0, 0}, 0, 0};
+        return true;
+    }
+
+    return store->put(data, len, manifest[index]);
+}
+
+ChunkImageReadBuf::ChunkImageReadBuf(const std::string &path, const std::string &pack_path)
+{
+    ChunkManifestHeader header;
+    valid = read_manifest(path, header, manifest);
+    if (valid) {
+        init_pages(header.image_size, header.chunk_size);
+        pack.open(pack_path, std::ios::binary);
+    }
+}
+
+bool ChunkImageReadBuf::load_page(uint64_t index, char *buf, size_t len)
+{
+    auto &ref = manifest[index];
+
+    if (ref.len == 0) {
+        memset(buf, 0, len);
+        return true;
+    }
+
+    if (ref.len != len)
+        return false;
+
+    pack.clear();
+    pack.seekg(ref.offset);
+    pack.read(buf, len);
+    return pack.gcount() == std::streamsize(len);
+}
@@ -1,6 +1,12 @@
 #include "circuit.h"
+#include "emu_utils.h"
 #include <sstream>
 #include <queue>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
 
 #include <cstdio>
 
@@ -16,95 +22,320 @@ constexpr R bitmask(unsigned int const onecount)
         & (static_cast<R>(-1) >> ((sizeof(R) * 8) - onecount));
 }
 
+// Run func(i) for i in [0, count) with the given number of threads
+template <typename F>
+void parallel_for(size_t count, size_t nthreads, F func)
+{
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::atomic<bool> failed(false);
+
+    auto worker = [&]() {
+        size_t i;
+        while (!failed.load(std::memory_order_relaxed) && (i = next.fetch_add(1)) < count) {
+            try {
+                func(i);
+            }
+            catch (...) {
+                if (!failed.exchange(true))
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nthreads; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// RAM images smaller than this are not worth spawning threads for
+constexpr BitVector::width_t parallel_ram_bits = 1 << 20;
+
 }; // namespace
 
 CircuitState::CircuitState(const SysInfo &sysinfo)
-    : scan_ff(sysinfo.scan_ff), scan_ram(sysinfo.scan_ram)
 {
     for (auto &it : sysinfo.wire) {
         BitVector data;
         if (it.second.init_zero)
             data = BitVector(it.second.width);
         else
-            data = BitVector(it.second.init_data);
-        wire[it.first].data = data;
+            data = BitVector::from_literal(it.second.init_data);
+        wire.emplace(names.intern(it.first), {std::move(data)});
     }
 
     for (auto &it : sysinfo.ram) {
         BitVectorArray data(it.second.width, it.second.depth, it.second.start_offset);
         if (!it.second.init_zero)
-            data.set_flattened_data(BitVector(it.second.init_data));
-        ram[it.first].data = data;
-        ram[it.first].dissolved = it.second.dissolved;
+            data.set_flattened_data(BitVector::from_literal(it.second.init_data));
+        ram.emplace(names.intern(it.first), {std::move(data), it.second.dissolved});
     }
+
+    build_scan_plan(sysinfo);
 }
 
-void CircuitState::load(Checkpoint &checkpoint)
+void CircuitState::build_scan_plan(const SysInfo &sysinfo)
 {
-    auto data_stream = checkpoint.axi_mems.at("scanchain").read();
-
-    size_t ff_size = 0, ff_offset = 0;
-    for (auto &info : scan_ff)
-        ff_size += info.width;
-
-    BitVector ff_data(ff_size);
-    data_stream.read(reinterpret_cast<char *>(ff_data.to_ptr()), (ff_size + 63) / 64 * 8);
-
-    for (auto &info : scan_ff) {
+    scan_ff_size = 0;
+    for (auto &info : sysinfo.scan_ff) {
         if (!info.name.empty()) {
             auto &data = wire.at(info.name).data;
-            data.setValue(info.offset, ff_data.getValue(ff_offset, info.width));
+            if (info.offset + info.width > data.width())
+                throw std::invalid_argument("scan chain FF " + join_string(info.name, '.') + " out of range");
+
+            // Merge with the previous range if both offsets are contiguous
+            auto *last = scan_ff_plan.empty() ? nullptr : &scan_ff_plan.back();
+            if (last && last->data == &data &&
+                    last->offset + last->width == info.offset &&
+                    last->scan_offset + last->width == scan_ff_size)
+                last->width += info.width;
+            else
+                scan_ff_plan.push_back({&data, BitVector::width_t(info.offset), scan_ff_size, BitVector::width_t(info.width)});
         }
-        ff_offset += info.width;
+        scan_ff_size += info.width;
     }
 
-    size_t mem_size = 0, ram_offset = 0;
-    for (auto &info : scan_ram)
-        mem_size += info.width * info.depth;
-
-    BitVector ram_data(mem_size);
-    data_stream.read(reinterpret_cast<char *>(ram_data.to_ptr()), (mem_size + 63) / 64 * 8);
-
-    for (auto &info : scan_ram) {
+    scan_ram_size = 0;
+    for (auto &info : sysinfo.scan_ram) {
         auto &data = ram.at(info.name).data;
-        for (int i = 0; i < info.depth; i++) {
-            data.set(data.start_offset() + i, ram_data.getValue(ram_offset, info.width));
-            ram_offset += info.width;
-        }
+        if (data.width() != info.width || data.depth() != info.depth)
+            throw std::invalid_argument("scan chain RAM " + join_string(info.name, '.') + " size mismatch");
+
+        BitVector::width_t size = BitVector::width_t(info.width) * info.depth;
+        scan_ram_plan.push_back({&data, scan_ram_size, size});
+        scan_ram_size += size;
     }
+
+    // Threads take the largest RAMs first for better balance
+    std::stable_sort(scan_ram_plan.begin(), scan_ram_plan.end(),
+        [](const ScanRAMRange &a, const ScanRAMRange &b) { return a.width > b.width; });
+}
+
+size_t CircuitState::ram_thread_count() const
+{
+    if (scan_ram_size < parallel_ram_bits || scan_ram_plan.size() < 2)
+        return 1;
+
+    size_t n = ram_threads != 0 ? ram_threads : std::max(1u, std::thread::hardware_concurrency());
+    return std::min(n, scan_ram_plan.size());
+}
+
+void CircuitState::load(Checkpoint &checkpoint)
+{
+    auto data_stream = checkpoint.axi_mems.at("scanchain").read();
+
+    BitVector ff_data(scan_ff_size);
+    data_stream->read(reinterpret_cast<char *>(ff_data.to_ptr()), (scan_ff_size + 63) / 64 * 8);
+
+    for (auto &range : scan_ff_plan)
+        range.data->setValue(range.offset, ff_data.view(range.scan_offset, range.width));
+
+    BitVector ram_data(scan_ram_size);
+    data_stream->read(reinterpret_cast<char *>(ram_data.to_ptr()), (scan_ram_size + 63) / 64 * 8);
+
+    // Each RAM is decoded into its own array, so threads never share outputs
+    parallel_for(scan_ram_plan.size(), ram_thread_count(), [&](size_t i) {
+        auto &range = scan_ram_plan[i];
+        range.data->set_flattened_data(ram_data.view(range.scan_offset, range.width));
+    });
 }
 
 void CircuitState::save(Checkpoint &checkpoint)
 {
     auto data_stream = checkpoint.axi_mems.at("scanchain").write();
 
-    size_t ff_size = 0, ff_offset = 0;
-    for (auto &info : scan_ff)
-        ff_size += info.width;
+    BitVector ff_data(scan_ff_size);
+
+    for (auto &range : scan_ff_plan)
+        ff_data.setValue(range.scan_offset, range.data->view(range.offset, range.width));
+
+    data_stream->write(reinterpret_cast<char *>(ff_data.to_ptr()), (scan_ff_size + 63) / 64 * 8);
+
+    BitVector ram_data(scan_ram_size);
+
+    // Adjacent RAMs may share a block of the image at their boundary, so
+    // threads only encode the whole blocks of each RAM, and the pieces
+    // before & after them are encoded afterwards
+
+    auto head_width = [](const ScanRAMRange &range) {
+        return std::min<BitVector::width_t>(range.width, (64 - range.scan_offset % 64) % 64);
+    };
+
+    auto tail_width = [&head_width](const ScanRAMRange &range) {
+        return (range.width - head_width(range)) % 64;
+    };
+
+    parallel_for(scan_ram_plan.size(), ram_thread_count(), [&](size_t i) {
+        auto &range = scan_ram_plan[i];
+        auto head = head_width(range), tail = tail_width(range);
+        auto body = range.width - head - tail;
+        if (body > 0)
+            ram_data.setValue(range.scan_offset + head, range.data->flattened_view().view(head, body));
+    });
+
+    for (auto &range : scan_ram_plan) {
+        auto head = head_width(range), tail = tail_width(range);
+        auto view = range.data->flattened_view();
+        if (head > 0)
+            ram_data.setValue(range.scan_offset, view.view(0, head));
+        if (tail > 0)
+            ram_data.setValue(range.scan_offset + range.width - tail, view.view(range.width - tail, tail));
+    }
+
+    data_stream->write(reinterpret_cast<char *>(ram_data.to_ptr()), (scan_ram_size + 63) / 64 * 8);
+    if (!data_stream->finish())
+        throw std::runtime_error("failed to write scan chain image");
+}
+
+LazyCircuitState::LazyCircuitState(const SysInfo &sysinfo) : modified(false)
+{
+    for (auto &it : sysinfo.wire)
+        wire.emplace(names.intern(it.first), {&it.second, {}});
 
-    BitVector ff_data(ff_size);
+    for (auto &it : sysinfo.ram)
+        ram.emplace(names.intern(it.first), {&it.second, false, 0, {}});
 
-    for (auto &info : scan_ff) {
+    scan_ff_size = 0;
+    for (auto &info : sysinfo.scan_ff) {
         if (!info.name.empty()) {
-            auto &data = wire.at(info.name).data;
-            ff_data.setValue(ff_offset, data.getValue(info.offset, info.width));
+            auto &entry = wire.at(info.name);
+            if (info.offset + info.width > entry.info->width)
+                throw std::invalid_argument("scan chain FF " + join_string(info.name, '.') + " out of range");
+
+            auto &ranges = entry.ranges;
+            if (!ranges.empty() &&
+                    ranges.back().offset + ranges.back().width == info.offset &&
+                    ranges.back().scan_offset + ranges.back().width == scan_ff_size)
+                ranges.back().width += info.width;
+            else
+                ranges.push_back({BitVector::width_t(info.offset), scan_ff_size, BitVector::width_t(info.width)});
         }
-        ff_offset += info.width;
+        scan_ff_size += info.width;
     }
-    data_stream.write(reinterpret_cast<char *>(ff_data.to_ptr()), (ff_size + 63) / 64 * 8);
 
-    size_t mem_size = 0, ram_offset = 0;
-    for (auto &info : scan_ram)
-        mem_size += info.width * info.depth;
+    scan_ram_size = 0;
+    for (auto &info : sysinfo.scan_ram) {
+        auto &entry = ram.at(info.name);
+        if (entry.info->width != info.width || entry.info->depth != info.depth)
+            throw std::invalid_argument("scan chain RAM " + join_string(info.name, '.') + " size mismatch");
 
-    BitVector ram_data(mem_size);
+        entry.scanned = true;
+        entry.scan_offset = scan_ram_size;
+        scan_ram_size += BitVector::width_t(info.width) * info.depth;
+    }
 
-    for (auto &info : scan_ram) {
-        auto &data = ram.at(info.name).data;
-        for (int i = 0; i < info.depth; i++) {
-            ram_data.setValue(ram_offset, data.get(data.start_offset() + i));
-            ram_offset += info.width;
-        }
+    for (auto &it : ram) {
+        auto &entry = it.second;
+        if (entry.scanned)
+            continue;
+        entry.unscanned = BitVectorArray(entry.info->width, entry.info->depth, entry.info->start_offset);
+        if (!entry.info->init_zero)
+            entry.unscanned.set_flattened_data(BitVector::from_literal(entry.info->init_data));
     }
-    data_stream.write(reinterpret_cast<char *>(ram_data.to_ptr()), (mem_size + 63) / 64 * 8);
+
+    ff_data = BitVector(scan_ff_size);
+    ram_data = BitVector(scan_ram_size);
+}
+
+void LazyCircuitState::load_ram_data()
+{
+    if (!ram_stream)
+        return;
+
+    ram_stream->read(reinterpret_cast<char *>(ram_data.to_ptr()), (scan_ram_size + 63) / 64 * 8);
+    ram_stream.reset();
+}
+
+BitVector LazyCircuitState::get_wire(NameTable::id_t id)
+{
+    auto &entry = wire.at(id);
+
+    BitVector::width_t scanned = 0;
+    for (auto &range : entry.ranges)
+        scanned += range.width;
+
+    BitVector value;
+    if (entry.info->init_zero || scanned == BitVector::width_t(entry.info->width))
+        value = BitVector(entry.info->width);
+    else
+        value = BitVector::from_literal(entry.info->init_data);
+
+    for (auto &range : entry.ranges)
+        value.setValue(range.offset, ff_data.view(range.scan_offset, range.width));
+
+    return value;
+}
+
+void LazyCircuitState::set_wire(NameTable::id_t id, const BitVector &value)
+{
+    auto &entry = wire.at(id);
+    if (value.width() != BitVector::width_t(entry.info->width))
+        throw std::invalid_argument("value width mismatch");
+
+    for (auto &range : entry.ranges)
+        ff_data.setValue(range.scan_offset, value.view(range.offset, range.width));
+
+    if (!entry.ranges.empty())
+        modified = true;
+}
+
+BitVector LazyCircuitState::get_ram(NameTable::id_t id, int64_t index)
+{
+    auto &entry = ram.at(id);
+    if (index < 0 || index >= entry.info->depth)
+        throw std::out_of_range("index out of range");
+
+    if (!entry.scanned)
+        return entry.unscanned.flattened_view().view(index * entry.info->width, entry.info->width).to_bitvector();
+
+    load_ram_data();
+    return ram_data.getValue(entry.scan_offset + index * entry.info->width, entry.info->width);
+}
+
+void LazyCircuitState::set_ram(NameTable::id_t id, int64_t index, const BitVector &value)
+{
+    auto &entry = ram.at(id);
+    if (value.width() != BitVector::width_t(entry.info->width))
+        throw std::invalid_argument("value width mismatch");
+
+    if (index < 0 || index >= entry.info->depth)
+        throw std::out_of_range("index out of range");
+
+    if (!entry.scanned)
+        return;
+
+    load_ram_data();
+    ram_data.setValue(entry.scan_offset + index * entry.info->width, value);
+    modified = true;
+}
+
+void LazyCircuitState::load(Checkpoint &checkpoint)
+{
+    auto data_stream = checkpoint.axi_mems.at("scanchain").read();
+    data_stream->read(reinterpret_cast<char *>(ff_data.to_ptr()), (scan_ff_size + 63) / 64 * 8);
+
+    ram_stream = std::move(data_stream);
+    modified = false;
+}
+
+void LazyCircuitState::save(Checkpoint &checkpoint)
+{
+    if (!modified)
+        return;
+
+    load_ram_data();
+
+    auto data_stream = checkpoint.axi_mems.at("scanchain").write();
+    data_stream->write(reinterpret_cast<char *>(ff_data.to_ptr()), (scan_ff_size + 63) / 64 * 8);
+    data_stream->write(reinterpret_cast<char *>(ram_data.to_ptr()), (scan_ram_size + 63) / 64 * 8);
+    if (!data_stream->finish())
+        throw std::runtime_error("failed to write scan chain image");
+
+    modified = false;
 }
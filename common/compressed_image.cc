@@ -0,0 +1,294 @@
+#include "compressed_image.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include <zlib.h>
+
+using namespace REMU;
+
+namespace {
+
+constexpr char compressed_magic[8] = {'R', 'E', 'M', 'U', 'Z', 'I', 'M', '1'};
+
+bool read_image_table(std::ifstream &f, CompressedImageHeader &header, std::vector<CompressedBlockEntry> &table)
+{
+    f.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (f.gcount() != sizeof(header) || memcmp(header.magic, compressed_magic, sizeof(compressed_magic)) != 0)
+        return false;
+
+    if (header.block_size == 0 ||
+            header.block_count != (header.image_size + header.block_size - 1) / header.block_size)
+        return false;
+
+    table.resize(header.block_count);
+    f.read(reinterpret_cast<char *>(table.data()), table.size() * sizeof(CompressedBlockEntry));
+    return f.gcount() == table.size() * sizeof(CompressedBlockEntry);
+}
+
+// Each image has its own workers, so their number is capped to keep
+// concurrent images from oversubscribing the host
+constexpr size_t max_workers = 4;
+
+size_t worker_count()
+{
+    return std::clamp<size_t>(std::thread::hardware_concurrency(), 1, max_workers);
+}
+
+}; // namespace
+
+bool REMU::is_compressed_image(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (f.fail())
+        return false;
+
+    char magic[sizeof(compressed_magic)];
+    f.read(magic, sizeof(magic));
+    return f.gcount() == sizeof(magic) && memcmp(magic, compressed_magic, sizeof(magic)) == 0;
+}
+
+CompressedImageWriteBuf::CompressedImageWriteBuf(const std::string &path, uint64_t image_size) :
+    PagedWriteBuf(image_size, COMPRESSED_BLOCK_SIZE), busy(0), stop(false), failed(false)
+{
+    file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    data_end = sizeof(CompressedImageHeader) + page_count * sizeof(CompressedBlockEntry);
+
+    // Blocks which are never written are zero blocks
+    table.assign(page_count, {0, 0, CompressedBlockEntry::ZERO});
+
+    size_t n = worker_count();
+    max_jobs = n * 2;
+    for (size_t i = 0; i < n; i++)
+        workers.emplace_back(&CompressedImageWriteBuf::worker, this);
+}
+
+CompressedImageWriteBuf::~CompressedImageWriteBuf()
+{
+    finish();
+}
+
+bool CompressedImageWriteBuf::finish_image()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this]() { return jobs.empty() && busy == 0; });
+        stop = true;
+    }
+    cond.notify_all();
+
+    for (auto &t : workers)
+        t.join();
+
+    CompressedImageHeader header;
+    memcpy(header.magic, compressed_magic, sizeof(compressed_magic));
+    header.image_size = image_size;
+    header.block_size = page_size;
+    header.block_count = page_count;
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(CompressedBlockEntry));
+    file.close();
+
+    return !failed && !file.fail();
+}
+
+int CompressedImageWriteBuf::sync()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this]() { return jobs.empty() && busy == 0; });
+        if (failed || !file)
+            return -1;
+    }
+
+    return PagedWriteBuf::sync();
+}
+
+void CompressedImageWriteBuf::worker()
+{
+    std::vector<char> out;
+
+    while (true) {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this]() { return stop || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            busy++;
+        }
+        cond.notify_all();
+
+        uLongf out_len = compressBound(job.data.size());
+        out.resize(out_len);
+
+        const char *data = job.data.data();
+        uint32_t len = job.data.size();
+        uint32_t type = CompressedBlockEntry::RAW;
+
+        // Blocks which do not compress are stored as they are
+        if (compress2(reinterpret_cast<Bytef *>(out.data()), &out_len,
+                reinterpret_cast<const Bytef *>(job.data.data()), job.data.size(), Z_BEST_SPEED) == Z_OK &&
+                out_len < job.data.size()) {
+            data = out.data();
+            len = out_len;
+            type = CompressedBlockEntry::ZLIB;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            file.seekp(data_end);
+            file.write(data, len);
+            if (file) {
+                table[job.index] = {data_end, len, type};
+                data_end += len;
+            }
+            else {
+                failed = true;
+            }
+            busy--;
+        }
+        cond.notify_all();
+    }
+}
+
+bool CompressedImageWriteBuf::commit_page(uint64_t index, const char *data, size_t len)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (failed || !file)
+        return false;
+
+    if (is_zero_page(data, len)) {
+        table[index] = {0, 0, CompressedBlockEntry::ZERO};
+        return true;
+    }
+
+    // Wait for workers to catch up
+    cond.wait(lock, [this]() { return jobs.size() + busy < max_jobs; });
+
+    jobs.push_back({index, std::vector<char>(data, data + len)});
+    lock.unlock();
+    cond.notify_all();
+
+    return true;
+}
+
+CompressedImageReadBuf::CompressedImageReadBuf(const std::string &path) :
+    file(path, std::ios::binary), stop(false), next_fetch(0)
+{
+    CompressedImageHeader header;
+    valid = !file.fail() && read_image_table(file, header, table);
+    if (!valid)
+        return;
+
+    init_pages(header.image_size, header.block_size);
+
+    size_t n = worker_count();
+    for (size_t i = 0; i < n; i++)
+        workers.emplace_back(&CompressedImageReadBuf::worker, this);
+}
+
+CompressedImageReadBuf::~CompressedImageReadBuf()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+
+    for (auto &t : workers)
+        t.join();
+}
+
+void CompressedImageReadBuf::worker()
+{
+    while (true) {
+        std::shared_ptr<Block> block;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this]() { return stop || !jobs.empty(); });
+            if (stop)
+                return;
+            block = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        std::vector<char> out(block->len);
+        uLongf out_len = block->len;
+        if (uncompress(reinterpret_cast<Bytef *>(out.data()), &out_len,
+                reinterpret_cast<const Bytef *>(block->data.data()), block->data.size()) != Z_OK ||
+                out_len != block->len)
+            out.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            block->data = std::move(out);
+            block->done = true;
+        }
+        cond.notify_all();
+    }
+}
+
+void CompressedImageReadBuf::fetch(uint64_t index)
+{
+    auto &entry = table[index];
+    auto block = std::make_shared<Block>();
+    block->len = page_len(index);
+    block->done = true;
+
+    if (entry.type != CompressedBlockEntry::ZERO) {
+        block->data.resize(entry.len);
+        file.clear();
+        file.seekg(entry.offset);
+        file.read(block->data.data(), entry.len);
+        if (file.gcount() != entry.len)
+            block->data.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(block);
+
+    if (entry.type == CompressedBlockEntry::ZLIB && !block->data.empty()) {
+        block->done = false;
+        jobs.push_back(block);
+        cond.notify_one();
+    }
+}
+
+bool CompressedImageReadBuf::load_page(uint64_t index, char *buf, size_t len)
+{
+    // Pages are loaded in order, so decompress a bounded number of the
+    // following blocks ahead
+    uint64_t ahead = index + workers.size() + 1;
+    while (next_fetch < page_count && next_fetch < ahead)
+        fetch(next_fetch++);
+
+    std::shared_ptr<Block> block;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (pending.empty())
+            return false;
+        block = std::move(pending.front());
+        pending.pop_front();
+        cond.wait(lock, [&block]() { return block->done; });
+    }
+
+    if (table[index].type == CompressedBlockEntry::ZERO) {
+        memset(buf, 0, len);
+        return true;
+    }
+
+    if (block->data.size() != len)
+        return false;
+
+    memcpy(buf, block->data.data(), len);
+    return true;
+}
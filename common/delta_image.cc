@@ -0,0 +1,173 @@
+#include "delta_image.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "emu_utils.h"
+
+using namespace REMU;
+
+namespace {
+
+constexpr char delta_magic[8] = {'R', 'E', 'M', 'U', 'D', 'L', 'T', '1'};
+
+bool read_image_table(const std::string &path, DeltaImageHeader &header, std::vector<DeltaPageEntry> &table)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (f.fail())
+        return false;
+
+    f.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (f.gcount() != sizeof(header) || memcmp(header.magic, delta_magic, sizeof(delta_magic)) != 0)
+        return false;
+
+    if (header.page_size == 0 ||
+            header.page_count != (header.image_size + header.page_size - 1) / header.page_size)
+        return false;
+
+    table.resize(header.page_count);
+    f.read(reinterpret_cast<char *>(table.data()), table.size() * sizeof(DeltaPageEntry));
+    return f.gcount() == table.size() * sizeof(DeltaPageEntry);
+}
+
+}; // namespace
+
+bool REMU::is_delta_image(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (f.fail())
+        return false;
+
+    char magic[sizeof(delta_magic)];
+    f.read(magic, sizeof(magic));
+    return f.gcount() == sizeof(magic) && memcmp(magic, delta_magic, sizeof(magic)) == 0;
+}
+
+bool DeltaPageReader::read(const DeltaPageEntry &entry, char *buf, size_t len)
+{
+    auto it = files.find(entry.tick);
+    if (it == files.end()) {
+        // Limit the number of open files for long delta chains
+        if (files.size() >= 64)
+            files.clear();
+        it = files.emplace(entry.tick, std::ifstream(resolve(entry.tick), std::ios::binary)).first;
+    }
+
+    auto &f = it->second;
+    f.clear();
+    f.seekg(entry.offset);
+    f.read(buf, len);
+    return f.gcount() == std::streamsize(len);
+}
+
+DeltaImageWriteBuf::DeltaImageWriteBuf(const std::string &path, uint64_t tick, uint64_t image_size,
+    const std::string &base_path, bool append, const DeltaPathResolver &resolve) :
+    PagedWriteBuf(image_size, DELTA_PAGE_SIZE), tick(tick), base_pages(resolve)
+{
+    memcpy(header.magic, delta_magic, sizeof(delta_magic));
+    header.image_size = image_size;
+    header.page_size = page_size;
+    header.page_count = page_count;
+
+    auto compatible = [this](const DeltaImageHeader &base) {
+        return base.image_size == header.image_size && base.page_size == header.page_size;
+    };
+
+    DeltaImageHeader base_header;
+
+    if (append && read_image_table(path, base_header, base_table) && compatible(base_header)) {
+        // Keep existing page data and append new pages after it
+        file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(0, std::ios::end);
+        data_end = file.tellp();
+    }
+    else {
+        if (base_path.empty() || !read_image_table(base_path, base_header, base_table) ||
+                !compatible(base_header))
+            base_table.clear();
+
+        file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+        data_end = sizeof(DeltaImageHeader) + page_count * sizeof(DeltaPageEntry);
+    }
+
+    // Pages which are never written are zero pages
+    table.assign(page_count, {DeltaPageEntry::ZERO_PAGE, 0, 0});
+}
+
+DeltaImageWriteBuf::~DeltaImageWriteBuf()
+{
+    finish();
+}
+
+bool DeltaImageWriteBuf::finish_image()
+{
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(DeltaPageEntry));
+    file.close();
+    return !file.fail();
+}
+
+int DeltaImageWriteBuf::sync()
+{
+    file.flush();
+    if (!file)
+        return -1;
+
+    return PagedWriteBuf::sync();
+}
+
+bool DeltaImageWriteBuf::commit_page(uint64_t index, const char *data, size_t len)
+{
+    if (!file)
+        return false;
+
+    auto &entry = table[index];
+
+    if (is_zero_page(data, len)) {
+        entry = {DeltaPageEntry::ZERO_PAGE, 0, 0};
+        return true;
+    }
+
+    uint64_t hash = hash_bytes(data, len);
+
+    if (!base_table.empty()) {
+        auto &base = base_table[index];
+        if (base.tick != DeltaPageEntry::ZERO_PAGE && base.hash == hash) {
+            // Hashes may collide, so only equal contents are shared
+            base_page_buf.resize(len);
+            if (base_pages.read(base, base_page_buf.data(), len) &&
+                    memcmp(base_page_buf.data(), data, len) == 0) {
+                entry = base;
+                return true;
+            }
+        }
+    }
+
+    file.seekp(data_end);
+    file.write(data, len);
+    entry = {tick, data_end, hash};
+    data_end += len;
+
+    return bool(file);
+}
+
+DeltaImageReadBuf::DeltaImageReadBuf(const std::string &path, const DeltaPathResolver &resolve) :
+    pages(resolve)
+{
+    valid = read_image_table(path, header, table);
+    if (valid)
+        init_pages(header.image_size, header.page_size);
+}
+
+bool DeltaImageReadBuf::load_page(uint64_t index, char *buf, size_t len)
+{
+    auto &entry = table[index];
+
+    if (entry.tick == DeltaPageEntry::ZERO_PAGE) {
+        memset(buf, 0, len);
+        return true;
+    }
+
+    return pages.read(entry, buf, len);
+}
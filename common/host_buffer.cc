@@ -0,0 +1,26 @@
+#include "host_buffer.h"
+
+#include <stdexcept>
+
+#include <sys/mman.h>
+
+using namespace REMU;
+
+HostBuffer::HostBuffer(size_t size) : len(size), locked(false)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        throw std::runtime_error("failed to allocate host buffer");
+
+    ptr = static_cast<char *>(p);
+
+    // Pinning is best-effort as it is limited by RLIMIT_MEMLOCK
+    locked = mlock(ptr, len) == 0;
+}
+
+HostBuffer::~HostBuffer()
+{
+    if (locked)
+        munlock(ptr, len);
+    munmap(ptr, len);
+}
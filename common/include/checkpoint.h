@@ -2,6 +2,8 @@
 #define _CHECKPOINT_H_
 
 #include <fstream>
+#include <memory>
+#include <optional>
 #include <set>
 #include <map>
 #include <unordered_set>
@@ -9,6 +11,9 @@
 
 #include "emu_info.h"
 #include "bitvector.h"
+#include "chunk_store.h"
+#include "delta_image.h"
+#include "trace_log.h"
 
 namespace REMU {
 
@@ -18,24 +23,73 @@ struct CheckpointInfo
     std::unordered_map<std::string, uint64_t> axi_size_map;
 };
 
+enum class CheckpointFormat
+{
+    Raw,    // full memory image
+    Delta,  // pages changed since the base checkpoint
+    Dedup,  // chunks in the content-addressed store shared by all checkpoints
+    Compressed, // zlib-compressed blocks
+};
+
 class CheckpointMem
 {
-    std::string mem_path;
+    std::string ckpt_root_path;
+    std::string name;
+    uint64_t tick;
     uint64_t mem_size;
 
+    // Format & base checkpoint for creating a new image.
+    // An existing image is always rewritten in its own format.
+    bool is_new;
+    CheckpointFormat format;
+    std::optional<uint64_t> base_tick;
+    std::shared_ptr<ChunkStore> chunk_store;
+
+    // cleared when moved from, so that only one object flushes the image
+    bool active = true;
+
+    std::string get_image_path(CheckpointFormat format, uint64_t tick) const;
+
+    // Format of the existing image
+    CheckpointFormat detect_format() const;
+
+    DeltaPathResolver delta_path_resolver() const;
+
 public:
 
-    std::ifstream read();
-    std::ofstream write();
+    std::unique_ptr<std::istream> read();
+    // The image is complete after finish() is called on the returned stream
+    std::unique_ptr<ImageOStream> write();
     void load(std::string file);
     void save(std::string file);
 
     void flush();
 
-    CheckpointMem(const std::string &path, uint64_t size) :
-        mem_path(path), mem_size(size) {}
+    CheckpointMem(const std::string &root, const std::string &name, uint64_t tick, uint64_t size,
+        bool is_new, CheckpointFormat format, std::optional<uint64_t> base_tick,
+        std::shared_ptr<ChunkStore> chunk_store) :
+        ckpt_root_path(root), name(name), tick(tick), mem_size(size),
+        is_new(is_new), format(format), base_tick(base_tick), chunk_store(chunk_store) {}
+
+    ~CheckpointMem()
+    {
+        if (active)
+            flush();
+    }
+
+    CheckpointMem(const CheckpointMem &) = delete;
+    CheckpointMem& operator=(const CheckpointMem &) = delete;
 
-    ~CheckpointMem() { flush(); }
+    CheckpointMem(CheckpointMem &&other) :
+        ckpt_root_path(std::move(other.ckpt_root_path)), name(std::move(other.name)),
+        tick(other.tick), mem_size(other.mem_size),
+        is_new(other.is_new), format(other.format), base_tick(other.base_tick),
+        chunk_store(std::move(other.chunk_store)), active(other.active)
+    {
+        other.active = false;
+    }
+
+    CheckpointMem& operator=(CheckpointMem &&) = delete;
 };
 
 class Checkpoint
@@ -43,28 +97,61 @@ class Checkpoint
     CheckpointInfo info;
     std::string ckpt_path;
 
-    std::string get_mem_path(std::string name);
-
 public:
 
     std::unordered_map<std::string, CheckpointMem> axi_mems;
 
-    Checkpoint(const CheckpointInfo &info, const std::string &path);
+    Checkpoint(const CheckpointInfo &info, const std::string &root, uint64_t tick,
+        bool is_new, CheckpointFormat format, std::optional<uint64_t> base_tick,
+        std::shared_ptr<ChunkStore> chunk_store);
 };
 
 class CheckpointManager
 {
     CheckpointInfo info;
+    std::shared_ptr<ChunkStore> chunk_store;
+
+    // Serializable data is saved to the trace log incrementally.
+    // Entries at or after log_mark are appended on flush, and entries before it
+    // are only changed by truncate() or by a checkpoint created in replay.
+    TraceLog trace_log;
+    uint64_t log_mark = 0;
+    std::optional<uint64_t> log_truncate;
+    std::optional<uint64_t> loaded_tick;
+
+    // Checkpoints being written in background, which are logged after commit()
+    std::set<uint64_t> deferred;
+
+    void load_trace_log();
+    void erase_after(uint64_t tick);
 
 public:
 
     std::string ckpt_root_path;
     void flush();
 
+    // Defer logging of a new checkpoint until its images are written
+    void defer(uint64_t tick) { deferred.insert(tick); }
+
+    // Log a deferred checkpoint on next flush
+    void commit(uint64_t tick) { deferred.erase(tick); }
+
+    // Remove a new checkpoint whose images failed to be written
+    void discard(uint64_t tick);
+
+    // export serializable data in JSON, or in portable binary if file ends with .bin
+    void export_metadata(const std::string &file);
+
+    // format of new checkpoints
+    CheckpointFormat format = CheckpointFormat::Raw;
+
     // SERIALIZABLE DATA BEGIN
 
     std::set<uint64_t> ticks;
 
+    // tick -> memory image format
+    std::map<uint64_t, CheckpointFormat> formats;
+
     // signal name -> { tick -> data }
     std::map<std::string, std::map<uint64_t, BitVector>> signal_trace;
 
@@ -0,0 +1,95 @@
+#ifndef _CHECKPOINT_WRITER_H_
+#define _CHECKPOINT_WRITER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <condition_variable>
+#include <unordered_map>
+
+#include "checkpoint.h"
+#include "host_buffer.h"
+
+namespace REMU {
+
+// Background checkpoint writer
+//
+// Memory images are copied from the device into host buffers, which are then
+// written to checkpoint images (and compressed) by a writer thread while
+// emulation continues.
+
+class CheckpointWriter
+{
+public:
+
+    // memory name -> image
+    using Images = std::unordered_map<std::string, std::unique_ptr<HostBuffer>>;
+
+    struct Result
+    {
+        uint64_t tick;
+        std::exception_ptr error;   // null if the checkpoint is written
+    };
+
+private:
+
+    struct Job
+    {
+        uint64_t tick;
+        std::unique_ptr<Checkpoint> ckpt;
+        Images images;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Job> jobs;
+    std::vector<Result> results;
+    bool busy;
+    bool stop;
+    size_t max_pending;
+    std::thread thread;
+
+    // buffers of written checkpoints for reuse
+    std::vector<std::unique_ptr<HostBuffer>> free_buffers;
+
+    void worker();
+
+public:
+
+    // Maximum number of checkpoints being written in background.
+    // 0 means checkpoints are written synchronously.
+    size_t get_max_pending() const { return max_pending; }
+    void set_max_pending(size_t max);
+
+    bool is_async() const { return max_pending != 0; }
+
+    // Wait until a new checkpoint can be submitted
+    void wait_slot();
+
+    // Wait until all submitted checkpoints are written
+    void drain();
+
+    // Results of checkpoints written since last call, in submission order
+    std::vector<Result> take_results();
+
+    std::unique_ptr<HostBuffer> alloc_buffer(size_t size);
+
+    // Write images to checkpoint memories in background
+    void submit(uint64_t tick, std::unique_ptr<Checkpoint> ckpt, Images &&images);
+
+    CheckpointWriter(size_t max_pending);
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter &) = delete;
+};
+
+};
+
+#endif // #ifndef _CHECKPOINT_WRITER_H_
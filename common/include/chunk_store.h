@@ -0,0 +1,166 @@
+#ifndef _CHUNK_STORE_H_
+#define _CHUNK_STORE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+
+#include "paged_stream.h"
+
+namespace REMU {
+
+// Content-addressed chunk store
+//
+// Memory images are split into fixed-size chunks keyed by a 128-bit hash of
+// their contents. Chunks are appended to a pack file shared by all
+// checkpoints and identical chunks are only stored once. Each checkpoint
+// image is a manifest listing the chunks it consists of.
+//
+// Store:    <root>/chunks/pack, <root>/chunks/index (ChunkRef records)
+// Manifest: ChunkManifestHeader | ChunkRef[chunk_count]
+
+struct ChunkKey
+{
+    uint64_t lo, hi;
+
+    bool operator==(const ChunkKey &other) const { return lo == other.lo && hi == other.hi; }
+};
+
+struct ChunkRef
+{
+    ChunkKey key;
+    uint64_t offset;    // offset in pack file
+    uint64_t len;       // 0 for a zero chunk, which is not stored
+};
+
+struct ChunkManifestHeader
+{
+    char magic[8];
+    uint64_t image_size;
+    uint64_t chunk_size;
+    uint64_t chunk_count;
+};
+
+constexpr uint64_t CHUNK_SIZE = 0x10000;
+
+class ChunkStore
+{
+    struct KeyHash
+    {
+        size_t operator()(const ChunkKey &key) const { return key.lo; }
+    };
+
+    std::string store_path;
+
+    std::mutex mutex;
+    bool opened;
+    std::ofstream pack;
+    std::ofstream index_file;
+    uint64_t pack_end;
+    std::unordered_map<ChunkKey, ChunkRef, KeyHash> index;
+
+    // Stored chunks with the same key are compared byte by byte, as the
+    // hash is not collision resistant
+    std::ifstream pack_reader;
+    std::vector<char> compare_buf;
+
+    void open();
+    bool stored_equal(const ChunkRef &ref, const char *data, size_t len);
+
+public:
+
+    std::string pack_path() const;
+    std::string index_path() const;
+
+    // Store a chunk if it does not exist yet, and get its reference.
+    // Returns false if the pack or the index cannot be written.
+    bool put(const char *data, size_t len, ChunkRef &ref);
+
+    // Make stored chunks visible to readers, and return false if any of
+    // them failed to be written
+    bool sync();
+
+    ChunkStore(const std::string &root);
+};
+
+class ChunkImageWriteBuf : public PagedWriteBuf
+{
+    std::shared_ptr<ChunkStore> store;
+    std::string path;
+    std::vector<ChunkRef> manifest;
+
+protected:
+
+    virtual bool commit_page(uint64_t index, const char *data, size_t len) override;
+
+    // The manifest is written after all chunks are stored
+    virtual bool finish_image() override;
+    virtual int sync() override;
+
+public:
+
+    ChunkImageWriteBuf(const std::string &path, uint64_t image_size, std::shared_ptr<ChunkStore> store);
+    ~ChunkImageWriteBuf();
+};
+
+class ChunkImageReadBuf : public PagedReadBuf
+{
+    std::ifstream pack;
+    std::vector<ChunkRef> manifest;
+    bool valid;
+
+protected:
+
+    virtual bool load_page(uint64_t index, char *buf, size_t len) override;
+
+public:
+
+    bool is_valid() const { return valid; }
+
+    ChunkImageReadBuf(const std::string &path, const std::string &pack_path);
+};
+
+class ChunkImageOStream : public ImageOStream
+{
+    ChunkImageWriteBuf buf;
+
+public:
+
+    virtual bool finish() override
+    {
+        if (!buf.finish())
+            setstate(std::ios::badbit);
+        return !bad();
+    }
+
+    ChunkImageOStream(const std::string &path, uint64_t image_size, std::shared_ptr<ChunkStore> store) :
+        buf(path, image_size, store)
+    {
+        rdbuf(&buf);
+    }
+};
+
+class ChunkImageIStream : public std::istream
+{
+    ChunkImageReadBuf buf;
+
+public:
+
+    ChunkImageIStream(const std::string &path, const std::string &pack_path) :
+        std::istream(nullptr), buf(path, pack_path)
+    {
+        rdbuf(&buf);
+        if (!buf.is_valid())
+            setstate(std::ios::failbit);
+    }
+};
+
+bool is_chunk_manifest(const std::string &path);
+
+};
+
+#endif // #ifndef _CHUNK_STORE_H_
@@ -4,21 +4,50 @@
 #include "emu_info.h"
 #include "checkpoint.h"
 #include "bitvector.h"
+#include "name_table.h"
 
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <stdexcept>
 
 namespace REMU {
 
 class CircuitState
 {
-    decltype(SysInfo::scan_ff) scan_ff;
-    decltype(SysInfo::scan_ram) scan_ram;
+    // Scan chain layout compiled from SysInfo, so that load & save copy each
+    // range with neither name lookups nor temporary vectors
+
+    struct ScanFFRange
+    {
+        BitVector *data;
+        BitVector::width_t offset;          // offset in the wire
+        BitVector::width_t scan_offset;     // offset in the scan chain data
+        BitVector::width_t width;
+    };
+
+    struct ScanRAMRange
+    {
+        BitVectorArray *data;
+        BitVector::width_t scan_offset;     // all words are copied at once
+        BitVector::width_t width;
+    };
+
+    std::vector<ScanFFRange> scan_ff_plan;
+    std::vector<ScanRAMRange> scan_ram_plan;
+    BitVector::width_t scan_ff_size, scan_ram_size;
+
+    void build_scan_plan(const SysInfo &sysinfo);
+
+    size_t ram_thread_count() const;
 
 public:
 
+    // Number of threads decoding & encoding RAMs in load & save, or 0 to use
+    // all hardware threads. Small RAM images are always handled by one thread.
+    size_t ram_threads = 0;
+
     struct WireState
     {
         BitVector data;
@@ -30,13 +59,88 @@ public:
         bool dissolved;
     };
 
-    std::map<std::vector<std::string>, WireState> wire;
-    std::map<std::vector<std::string>, RAMState> ram;
+    // Names of all wires & RAMs, which address the states below
+    NameTable names;
+
+    NameMap<WireState> wire{names};
+    NameMap<RAMState> ram{names};
 
     void load(Checkpoint &checkpoint);
     void save(Checkpoint &checkpoint);
 
     CircuitState(const SysInfo &sysinfo);
+
+    // The scan plan points into this object
+    CircuitState(const CircuitState &) = delete;
+    CircuitState &operator=(const CircuitState &) = delete;
+};
+
+// On-demand view of the circuit state in a checkpoint
+//
+// load() only reads the FF part of the scan chain image, and the RAM part is
+// read on first access. Values are decoded from the image when requested,
+// and writes are encoded into the image directly, which is written back by
+// save() only if modified. Bits outside the scan chain read as their initial
+// values, and writes to them are dropped as they are not checkpointed.
+//
+// The SysInfo passed to the constructor must outlive this object.
+
+class LazyCircuitState
+{
+public:
+
+    struct ScanRange
+    {
+        BitVector::width_t offset;          // offset in the wire
+        BitVector::width_t scan_offset;     // offset in the FF image
+        BitVector::width_t width;
+    };
+
+    struct WireEntry
+    {
+        const SysInfo::WireInfo *info;
+        std::vector<ScanRange> ranges;
+    };
+
+    struct RAMEntry
+    {
+        const SysInfo::RAMInfo *info;
+        bool scanned;
+        BitVector::width_t scan_offset;     // offset in the RAM image, valid if scanned
+        BitVectorArray unscanned;           // initial data, valid if !scanned
+    };
+
+private:
+
+    BitVector::width_t scan_ff_size, scan_ram_size;
+
+    BitVector ff_data, ram_data;
+    std::unique_ptr<std::istream> ram_stream;   // pending RAM image
+    bool modified;
+
+    void load_ram_data();
+
+public:
+
+    NameTable names;
+
+    NameMap<WireEntry> wire{names};
+    NameMap<RAMEntry> ram{names};
+
+    BitVector get_wire(NameTable::id_t id);
+    void set_wire(NameTable::id_t id, const BitVector &value);
+
+    // index is relative to the start offset of the RAM
+    BitVector get_ram(NameTable::id_t id, int64_t index);
+    void set_ram(NameTable::id_t id, int64_t index, const BitVector &value);
+
+    void load(Checkpoint &checkpoint);
+    void save(Checkpoint &checkpoint);
+
+    LazyCircuitState(const SysInfo &sysinfo);
+
+    LazyCircuitState(const LazyCircuitState &) = delete;
+    LazyCircuitState &operator=(const LazyCircuitState &) = delete;
 };
 
 struct CircuitPath : public std::vector<std::string>
@@ -0,0 +1,166 @@
+#ifndef _COMPRESSED_IMAGE_H_
+#define _COMPRESSED_IMAGE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <fstream>
+#include <condition_variable>
+
+#include "paged_stream.h"
+
+namespace REMU {
+
+// Compressed memory image
+//
+// The image is split into fixed-size blocks which are compressed with zlib
+// independently, so that blocks are compressed by multiple threads while
+// being written and decompressed ahead while being read. Zero blocks are
+// stored as holes which take no space.
+//
+// Layout: CompressedImageHeader | CompressedBlockEntry[block_count] | block data
+
+struct CompressedImageHeader
+{
+    char magic[8];
+    uint64_t image_size;
+    uint64_t block_size;
+    uint64_t block_count;
+};
+
+struct CompressedBlockEntry
+{
+    enum : uint32_t
+    {
+        ZERO = 0,   // hole
+        RAW,        // stored uncompressed as it does not compress
+        ZLIB,
+    };
+
+    uint64_t offset;
+    uint32_t len;
+    uint32_t type;
+};
+
+constexpr uint64_t COMPRESSED_BLOCK_SIZE = 0x40000;
+
+class CompressedImageWriteBuf : public PagedWriteBuf
+{
+    std::ofstream file;
+    uint64_t data_end;
+    std::vector<CompressedBlockEntry> table;
+
+    struct Job
+    {
+        uint64_t index;
+        std::vector<char> data;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Job> jobs;
+    size_t max_jobs;
+    size_t busy;
+    bool stop;
+    bool failed;    // a block could not be written
+    std::vector<std::thread> workers;
+
+    void worker();
+
+protected:
+
+    virtual bool commit_page(uint64_t index, const char *data, size_t len) override;
+
+    // Wait for queued blocks & write the block table
+    virtual bool finish_image() override;
+
+    // Wait for queued blocks, and fail if any of them could not be written
+    virtual int sync() override;
+
+public:
+
+    CompressedImageWriteBuf(const std::string &path, uint64_t image_size);
+    ~CompressedImageWriteBuf();
+};
+
+class CompressedImageReadBuf : public PagedReadBuf
+{
+    std::ifstream file;
+    std::vector<CompressedBlockEntry> table;
+    bool valid;
+
+    struct Block
+    {
+        std::vector<char> data;     // compressed data, then decompressed data
+        size_t len;                 // decompressed length
+        bool done;
+    };
+
+    // Blocks read ahead in order, which are decompressed by workers
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<Block>> pending;
+    std::deque<std::shared_ptr<Block>> jobs;
+    bool stop;
+    std::vector<std::thread> workers;
+    uint64_t next_fetch;
+
+    void worker();
+    void fetch(uint64_t index);
+
+protected:
+
+    virtual bool load_page(uint64_t index, char *buf, size_t len) override;
+
+public:
+
+    bool is_valid() const { return valid; }
+
+    CompressedImageReadBuf(const std::string &path);
+    ~CompressedImageReadBuf();
+};
+
+class CompressedImageOStream : public ImageOStream
+{
+    CompressedImageWriteBuf buf;
+
+public:
+
+    virtual bool finish() override
+    {
+        if (!buf.finish())
+            setstate(std::ios::badbit);
+        return !bad();
+    }
+
+    CompressedImageOStream(const std::string &path, uint64_t image_size) :
+        buf(path, image_size)
+    {
+        rdbuf(&buf);
+    }
+};
+
+class CompressedImageIStream : public std::istream
+{
+    CompressedImageReadBuf buf;
+
+public:
+
+    CompressedImageIStream(const std::string &path) :
+        std::istream(nullptr), buf(path)
+    {
+        rdbuf(&buf);
+        if (!buf.is_valid())
+            setstate(std::ios::failbit);
+    }
+};
+
+bool is_compressed_image(const std::string &path);
+
+};
+
+#endif // #ifndef _COMPRESSED_IMAGE_H_
@@ -0,0 +1,149 @@
+#ifndef _DELTA_IMAGE_H_
+#define _DELTA_IMAGE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <functional>
+
+#include "paged_stream.h"
+
+namespace REMU {
+
+// Delta memory image
+//
+// A delta image only stores the pages which differ from its base image. The
+// page table maps every page of the full image to either a zero page or a
+// location in this or an earlier delta image, so a full image can be rebuilt
+// from a single page table regardless of the length of the delta chain.
+//
+// Layout:  DeltaImageHeader | DeltaPageEntry[page_count] | page data ...
+
+struct DeltaImageHeader
+{
+    char magic[8];
+    uint64_t image_size;
+    uint64_t page_size;
+    uint64_t page_count;
+};
+
+struct DeltaPageEntry
+{
+    static constexpr uint64_t ZERO_PAGE = UINT64_MAX;
+
+    uint64_t tick;      // tick of the checkpoint holding the page, or ZERO_PAGE
+    uint64_t offset;    // file offset of page data
+    uint64_t hash;
+};
+
+constexpr uint64_t DELTA_PAGE_SIZE = 0x10000;
+
+// tick -> delta image path of the same memory region
+using DeltaPathResolver = std::function<std::string(uint64_t)>;
+
+// Open files of delta images, which are read by page entries
+class DeltaPageReader
+{
+    DeltaPathResolver resolve;
+    std::map<uint64_t, std::ifstream> files;
+
+public:
+
+    bool read(const DeltaPageEntry &entry, char *buf, size_t len);
+
+    DeltaPageReader(const DeltaPathResolver &resolve) : resolve(resolve) {}
+};
+
+class DeltaImageWriteBuf : public PagedWriteBuf
+{
+    std::fstream file;
+    uint64_t tick;
+
+    DeltaImageHeader header;
+    std::vector<DeltaPageEntry> base_table;
+    std::vector<DeltaPageEntry> table;
+
+    uint64_t data_end;
+
+    // Pages with the same hash as base pages are compared byte by byte
+    DeltaPageReader base_pages;
+    std::vector<char> base_page_buf;
+
+protected:
+
+    virtual bool commit_page(uint64_t index, const char *data, size_t len) override;
+    virtual bool finish_image() override;
+    virtual int sync() override;
+
+public:
+
+    // If append is true, the existing image at path is used as the base and
+    // its page data is kept intact, as later checkpoints may refer to it.
+    DeltaImageWriteBuf(const std::string &path, uint64_t tick, uint64_t image_size,
+        const std::string &base_path, bool append, const DeltaPathResolver &resolve);
+    ~DeltaImageWriteBuf();
+};
+
+class DeltaImageReadBuf : public PagedReadBuf
+{
+    DeltaImageHeader header;
+    std::vector<DeltaPageEntry> table;
+    bool valid;
+
+    DeltaPageReader pages;
+
+protected:
+
+    virtual bool load_page(uint64_t index, char *buf, size_t len) override;
+
+public:
+
+    bool is_valid() const { return valid; }
+
+    DeltaImageReadBuf(const std::string &path, const DeltaPathResolver &resolve);
+};
+
+class DeltaImageOStream : public ImageOStream
+{
+    DeltaImageWriteBuf buf;
+
+public:
+
+    virtual bool finish() override
+    {
+        if (!buf.finish())
+            setstate(std::ios::badbit);
+        return !bad();
+    }
+
+    DeltaImageOStream(const std::string &path, uint64_t tick, uint64_t image_size,
+        const std::string &base_path, bool append, const DeltaPathResolver &resolve) :
+        buf(path, tick, image_size, base_path, append, resolve)
+    {
+        rdbuf(&buf);
+    }
+};
+
+class DeltaImageIStream : public std::istream
+{
+    DeltaImageReadBuf buf;
+
+public:
+
+    DeltaImageIStream(const std::string &path, const DeltaPathResolver &resolve) :
+        std::istream(nullptr), buf(path, resolve)
+    {
+        rdbuf(&buf);
+        if (!buf.is_valid())
+            setstate(std::ios::failbit);
+    }
+};
+
+bool is_delta_image(const std::string &path);
+
+};
+
+#endif // #ifndef _DELTA_IMAGE_H_
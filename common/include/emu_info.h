@@ -16,7 +16,7 @@ struct SysInfo
         int start_offset;
         bool upto;
         bool init_zero;
-        std::string init_data; // valid if !init_zero
+        std::string init_data; // valid if !init_zero, parsed by BitVector::from_literal
     };
 
     struct RAMInfo
@@ -25,7 +25,7 @@ struct SysInfo
         int depth;
         int start_offset;
         bool init_zero;
-        std::string init_data; // valid if !init_zero
+        std::string init_data; // valid if !init_zero, parsed by BitVector::from_literal
         bool dissolved;
     };
 
@@ -2,6 +2,7 @@
 #define _EMU_UTILS_H_
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -60,6 +61,41 @@ inline std::string flatten_name(const std::vector<std::string> &name)
     return ss.str();
 }
 
+// MurmurHash64A by Austin Appleby (public domain)
+inline uint64_t hash_bytes(const void *data, size_t len, uint64_t seed = 0)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    uint64_t h = seed ^ (len * m);
+
+    auto p = static_cast<const unsigned char *>(data);
+    auto end = p + (len & ~size_t(7));
+
+    for (; p != end; p += 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    if (len & 7) {
+        uint64_t k = 0;
+        memcpy(&k, p, len & 7);
+        h ^= k;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
 } // namespace REMU
 
 #endif // #ifndef _EMU_UTILS_H_
@@ -0,0 +1,48 @@
+#ifndef _HOST_BUFFER_H_
+#define _HOST_BUFFER_H_
+
+#include <cstddef>
+#include <iostream>
+
+namespace REMU {
+
+// Page-aligned host buffer locked in memory if allowed
+class HostBuffer
+{
+    char *ptr;
+    size_t len;
+    bool locked;
+
+public:
+
+    char *data() { return ptr; }
+    const char *data() const { return ptr; }
+    size_t size() const { return len; }
+
+    HostBuffer(size_t size);
+    ~HostBuffer();
+
+    HostBuffer(const HostBuffer &) = delete;
+    HostBuffer& operator=(const HostBuffer &) = delete;
+};
+
+class HostBufferOStream : public std::ostream
+{
+    class Buf : public std::streambuf
+    {
+    public:
+        Buf(char *data, size_t size) { setp(data, data + size); }
+    } buf;
+
+public:
+
+    HostBufferOStream(HostBuffer &buffer) :
+        std::ostream(nullptr), buf(buffer.data(), buffer.size())
+    {
+        rdbuf(&buf);
+    }
+};
+
+};
+
+#endif // #ifndef _HOST_BUFFER_H_
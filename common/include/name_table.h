@@ -0,0 +1,162 @@
+#ifndef _NAME_TABLE_H_
+#define _NAME_TABLE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace REMU {
+
+// Interned hierarchical names
+//
+// Each name is a node holding its parent node and its last path component,
+// so that common prefixes are stored once. Components are interned as
+// strings, and nodes are addressed by dense ids. Child nodes are found by a
+// hash lookup on (parent, component).
+
+class NameTable
+{
+public:
+
+    using id_t = uint32_t;
+
+    static constexpr id_t root = 0;
+    static constexpr id_t npos = ~id_t(0);
+
+private:
+
+    struct Node
+    {
+        id_t parent;
+        uint32_t component;
+    };
+
+    std::vector<std::string> components;
+    std::unordered_map<std::string, uint32_t> component_ids;
+
+    std::vector<Node> nodes;
+    std::unordered_map<uint64_t, id_t> children;
+
+    static uint64_t child_key(id_t parent, uint32_t component)
+    {
+        return (uint64_t(parent) << 32) | component;
+    }
+
+public:
+
+    // Add a path and return its id, which is unchanged if the path exists
+    id_t intern(const std::vector<std::string> &path);
+    id_t intern(id_t parent, const std::string &component);
+
+    // These return npos if the path does not exist
+    id_t find(const std::vector<std::string> &path) const { return find(root, path); }
+    id_t find(id_t parent, const std::vector<std::string> &path) const;
+    id_t find(id_t parent, const std::string &component) const;
+
+    id_t parent(id_t id) const { return nodes.at(id).parent; }
+    const std::string &component(id_t id) const { return components.at(nodes.at(id).component); }
+
+    std::vector<std::string> path(id_t id) const;
+
+    // Path components escaped as Verilog identifiers and joined by "."
+    std::string flat_name(id_t id) const;
+
+    // number of nodes, which bounds all ids
+    size_t size() const { return nodes.size(); }
+
+    NameTable() : nodes{{npos, 0}} { components.emplace_back(); }
+};
+
+// Values addressed by names in a NameTable
+//
+// Entries are kept in insertion order and indexed by name id, so lookups by
+// id are a vector access.
+
+template<typename T>
+class NameMap
+{
+    const NameTable *names;
+    std::vector<std::pair<NameTable::id_t, T>> entries;
+    std::vector<uint32_t> index;
+
+    static constexpr uint32_t none = ~uint32_t(0);
+
+public:
+
+    using iterator = typename decltype(entries)::iterator;
+    using const_iterator = typename decltype(entries)::const_iterator;
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    const NameTable &name_table() const { return *names; }
+
+    T &emplace(NameTable::id_t id, T value)
+    {
+        if (id >= index.size())
+            index.resize(id + 1, none);
+
+        if (index[id] != none)
+            throw std::invalid_argument("duplicate name " + names->flat_name(id));
+
+        index[id] = entries.size();
+        entries.emplace_back(id, std::move(value));
+        return entries.back().second;
+    }
+
+    // These return nullptr if the name is absent
+    T *find(NameTable::id_t id)
+    {
+        if (id >= index.size() || index[id] == none)
+            return nullptr;
+        return &entries[index[id]].second;
+    }
+
+    const T *find(NameTable::id_t id) const
+    {
+        return const_cast<NameMap *>(this)->find(id);
+    }
+
+    T *find(const std::vector<std::string> &path) { return find(names->find(path)); }
+    const T *find(const std::vector<std::string> &path) const { return find(names->find(path)); }
+
+    T &at(NameTable::id_t id)
+    {
+        T *value = find(id);
+        if (!value)
+            throw std::out_of_range("name not found");
+        return *value;
+    }
+
+    const T &at(NameTable::id_t id) const
+    {
+        return const_cast<NameMap *>(this)->at(id);
+    }
+
+    T &at(const std::vector<std::string> &path)
+    {
+        T *value = find(path);
+        if (!value)
+            throw std::out_of_range("name not found");
+        return *value;
+    }
+
+    const T &at(const std::vector<std::string> &path) const
+    {
+        return const_cast<NameMap *>(this)->at(path);
+    }
+
+    NameMap(const NameTable &names) : names(&names) {}
+};
+
+};
+
+#endif // #ifndef _NAME_TABLE_H_
@@ -0,0 +1,105 @@
+#ifndef _PAGED_STREAM_H_
+#define _PAGED_STREAM_H_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <iostream>
+
+namespace REMU {
+
+// Stream buffers which encode/decode a memory image of known size in
+// fixed-size pages. Full pages are passed in place without copying.
+
+inline bool is_zero_page(const char *data, size_t len)
+{
+    return len == 0 || (data[0] == 0 && memcmp(data, data + 1, len - 1) == 0);
+}
+
+class PagedWriteBuf : public std::streambuf
+{
+    std::vector<char> page_buf;
+    bool failed;
+    bool finished;
+
+    // commit_page, which marks the image as failed if the page is not committed
+    bool commit(uint64_t index, const char *data, size_t len);
+
+protected:
+
+    uint64_t image_size;
+    uint64_t page_size;
+    uint64_t page_count;
+    uint64_t next_page;
+
+    size_t page_len(uint64_t index) const;
+
+    // Called for each page in order. The last page may be shorter.
+    virtual bool commit_page(uint64_t index, const char *data, size_t len) = 0;
+
+    // Called once by finish() to write the metadata of the image
+    virtual bool finish_image() { return true; }
+
+    // Commit the pending partial page, padded with zeros
+    bool flush_pages();
+
+    bool has_failed() const { return failed; }
+
+    // Full pages are committed as soon as they are filled, and a partial page
+    // is only committed by finish(), so this reports failed commits
+    virtual int sync() override;
+
+    virtual int_type overflow(int_type ch) override;
+    virtual std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+public:
+
+    // Commit the remaining pages & write the image metadata, and return false
+    // if any of them failed. This must be called in the destructor of derived
+    // classes if it has not been called.
+    bool finish();
+
+    PagedWriteBuf(uint64_t image_size, uint64_t page_size);
+};
+
+// Output stream of a memory image, which is complete after finish()
+class ImageOStream : public std::ostream
+{
+public:
+
+    // Complete the image, and set badbit on failure
+    virtual bool finish() = 0;
+
+    ImageOStream() : std::ostream(nullptr) {}
+};
+
+class PagedReadBuf : public std::streambuf
+{
+    std::vector<char> page_buf;
+
+protected:
+
+    uint64_t image_size;
+    uint64_t page_size;
+    uint64_t page_count;
+    uint64_t next_page;
+
+    size_t page_len(uint64_t index) const;
+
+    // Called for each page in order. The last page may be shorter.
+    virtual bool load_page(uint64_t index, char *buf, size_t len) = 0;
+
+    // This must be called before reading if the image size is unknown at construction.
+    void init_pages(uint64_t image_size, uint64_t page_size);
+
+    virtual int_type underflow() override;
+    virtual std::streamsize xsgetn(char *s, std::streamsize n) override;
+
+public:
+
+    PagedReadBuf(uint64_t image_size = 0, uint64_t page_size = 1) { init_pages(image_size, page_size); }
+};
+
+};
+
+#endif // #ifndef _PAGED_STREAM_H_
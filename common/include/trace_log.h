@@ -0,0 +1,89 @@
+#ifndef _TRACE_LOG_H_
+#define _TRACE_LOG_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+
+#include "bitvector.h"
+
+namespace REMU {
+
+// Binary append-only log of checkpoint metadata
+//
+// The log begins with a magic and is followed by records, each consisting of
+// a TraceLogRecordHeader and a payload. Signal names are stored once in Signal
+// records, which form an index of signal names referred to by Value records.
+// Records are applied in order, so a later record overrides an earlier one.
+//
+// Signal:      uint32_t id | char name[]
+// Tick:        uint64_t tick
+// Format:      uint64_t tick | uint32_t format
+// Value:       uint64_t tick | uint32_t id | uint32_t reserved | uint64_t width | uint64_t data[]
+// Truncate:    uint64_t tick
+
+struct TraceLogRecordHeader
+{
+    uint32_t type;
+    uint32_t size;
+};
+
+class TraceLog
+{
+public:
+
+    enum RecordType : uint32_t
+    {
+        Signal = 1,
+        Tick,
+        Format,
+        Value,
+        Truncate,
+    };
+
+    struct Record
+    {
+        RecordType type;
+        uint64_t tick;
+        uint32_t format;
+        const std::string *signal;
+        BitVector value;
+    };
+
+private:
+
+    std::string path;
+    std::ofstream file;
+    bool scanned;
+    uint64_t valid_end;
+    std::unordered_map<std::string, uint32_t> signal_ids;
+    std::vector<std::string> signal_names;
+    std::vector<char> record_buf;
+
+    void open();
+    void append(RecordType type, size_t size);
+
+public:
+
+    bool exists() const;
+
+    // Read all records in order. An incomplete record left by an interrupted write is dropped.
+    void read(const std::function<void(const Record &)> &handler);
+
+    void append_tick(uint64_t tick);
+    void append_format(uint64_t tick, uint32_t format);
+    void append_value(const std::string &signal, uint64_t tick, const BitVector &value);
+    void append_truncate(uint64_t tick);
+
+    // Make appended records persistent
+    void sync();
+
+    TraceLog(const std::string &path);
+};
+
+};
+
+#endif // #ifndef _TRACE_LOG_H_
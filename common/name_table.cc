@@ -0,0 +1,76 @@
+#include "name_table.h"
+#include "escape.h"
+
+#include <algorithm>
+
+using namespace REMU;
+
+NameTable::id_t NameTable::intern(const std::vector<std::string> &path)
+{
+    id_t id = root;
+    for (auto &component : path)
+        id = intern(id, component);
+    return id;
+}
+
+NameTable::id_t NameTable::intern(id_t parent, const std::string &component)
+{
+    auto comp_it = component_ids.find(component);
+    if (comp_it == component_ids.end()) {
+        comp_it = component_ids.emplace(component, components.size()).first;
+        components.push_back(component);
+    }
+
+    auto res = children.emplace(child_key(parent, comp_it->second), nodes.size());
+    if (res.second)
+        nodes.push_back({parent, comp_it->second});
+
+    return res.first->second;
+}
+
+NameTable::id_t NameTable::find(id_t parent, const std::vector<std::string> &path) const
+{
+    id_t id = parent;
+    for (auto &component : path) {
+        id = find(id, component);
+        if (id == npos)
+            break;
+    }
+    return id;
+}
+
+NameTable::id_t NameTable::find(id_t parent, const std::string &component) const
+{
+    if (parent == npos)
+        return npos;
+
+    auto comp_it = component_ids.find(component);
+    if (comp_it == component_ids.end())
+        return npos;
+
+    auto it = children.find(child_key(parent, comp_it->second));
+    if (it == children.end())
+        return npos;
+
+    return it->second;
+}
+
+std::vector<std::string> NameTable::path(id_t id) const
+{
+    std::vector<std::string> res;
+    for (; id != root; id = nodes.at(id).parent)
+        res.push_back(components.at(nodes.at(id).component));
+    std::reverse(res.begin(), res.end());
+    return res;
+}
+
+std::string NameTable::flat_name(id_t id) const
+{
+    std::string res;
+    for (auto &component : path(id)) {
+        if (!res.empty())
+            res += ".";
+        res += Escape::escape_verilog_id(component);
+    }
+    return res;
+}
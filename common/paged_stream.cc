@@ -0,0 +1,192 @@
+#include "paged_stream.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace REMU;
+
+PagedWriteBuf::PagedWriteBuf(uint64_t image_size, uint64_t page_size) :
+    page_buf(page_size),
+    failed(false),
+    finished(false),
+    image_size(image_size),
+    page_size(page_size),
+    page_count((image_size + page_size - 1) / page_size),
+    next_page(0)
+{
+    setp(page_buf.data(), page_buf.data() + page_buf.size());
+}
+
+size_t PagedWriteBuf::page_len(uint64_t index) const
+{
+    return std::min(page_size, image_size - index * page_size);
+}
+
+bool PagedWriteBuf::commit(uint64_t index, const char *data, size_t len)
+{
+    try {
+        if (commit_page(index, data, len))
+            return true;
+    }
+    catch (...) {
+        failed = true;
+        throw;
+    }
+
+    failed = true;
+    return false;
+}
+
+bool PagedWriteBuf::flush_pages()
+{
+    if (pptr() == pbase())
+        return !failed;
+
+    std::fill(pptr(), epptr(), 0);
+    if (next_page < page_count)
+        commit(next_page, pbase(), page_len(next_page));
+    next_page++;
+    setp(page_buf.data(), page_buf.data() + page_buf.size());
+    return !failed;
+}
+
+bool PagedWriteBuf::finish()
+{
+    if (finished)
+        return !failed;
+
+    finished = true;
+
+    // Metadata is always written, as derived classes may release resources there
+    bool ok = false;
+    try {
+        ok = flush_pages();
+    }
+    catch (...) {}
+
+    try {
+        if (!finish_image())
+            ok = false;
+    }
+    catch (...) {
+        ok = false;
+    }
+
+    if (!ok)
+        failed = true;
+
+    return ok;
+}
+
+int PagedWriteBuf::sync()
+{
+    return failed ? -1 : 0;
+}
+
+PagedWriteBuf::int_type PagedWriteBuf::overflow(int_type ch)
+{
+    if (pptr() == epptr()) {
+        // data beyond image size is discarded
+        if (next_page < page_count && !commit(next_page, pbase(), page_len(next_page)))
+            return traits_type::eof();
+        next_page++;
+        setp(page_buf.data(), page_buf.data() + page_buf.size());
+    }
+
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::not_eof(ch);
+
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+    return ch;
+}
+
+std::streamsize PagedWriteBuf::xsputn(const char *s, std::streamsize n)
+{
+    std::streamsize done = 0;
+
+    while (done < n) {
+        // Pass full pages in place if there is nothing buffered
+        if (pptr() == pbase() && n - done >= std::streamsize(page_size)) {
+            if (next_page < page_count && !commit(next_page, s + done, page_len(next_page)))
+                break;
+            next_page++;
+            done += page_size;
+            continue;
+        }
+
+        std::streamsize slice = std::min<std::streamsize>(epptr() - pptr(), n - done);
+        memcpy(pptr(), s + done, slice);
+        pbump(slice);
+        done += slice;
+
+        if (pptr() == epptr() && traits_type::eq_int_type(overflow(traits_type::eof()), traits_type::eof()))
+            break;
+    }
+
+    return done;
+}
+
+void PagedReadBuf::init_pages(uint64_t image_size, uint64_t page_size)
+{
+    this->image_size = image_size;
+    this->page_size = page_size;
+    this->page_count = (image_size + page_size - 1) / page_size;
+    this->next_page = 0;
+    page_buf.resize(page_size);
+    setg(page_buf.data(), page_buf.data(), page_buf.data());
+}
+
+size_t PagedReadBuf::page_len(uint64_t index) const
+{
+    return std::min(page_size, image_size - index * page_size);
+}
+
+PagedReadBuf::int_type PagedReadBuf::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    if (next_page >= page_count)
+        return traits_type::eof();
+
+    auto len = page_len(next_page);
+    if (!load_page(next_page, page_buf.data(), len))
+        return traits_type::eof();
+
+    next_page++;
+    setg(page_buf.data(), page_buf.data(), page_buf.data() + len);
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize PagedReadBuf::xsgetn(char *s, std::streamsize n)
+{
+    std::streamsize done = 0;
+
+    while (done < n) {
+        if (gptr() < egptr()) {
+            std::streamsize slice = std::min<std::streamsize>(egptr() - gptr(), n - done);
+            memcpy(s + done, gptr(), slice);
+            gbump(slice);
+            done += slice;
+            continue;
+        }
+
+        if (next_page >= page_count)
+            break;
+
+        // Load full pages directly into the destination
+        auto len = page_len(next_page);
+        if (n - done >= std::streamsize(len)) {
+            if (!load_page(next_page, s + done, len))
+                break;
+            next_page++;
+            done += len;
+        }
+        else if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+            break;
+        }
+    }
+
+    return done;
+}
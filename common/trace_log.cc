@@ -0,0 +1,231 @@
+#include "trace_log.h"
+
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+using namespace REMU;
+
+namespace {
+
+constexpr char trace_log_magic[8] = {'R', 'E', 'M', 'U', 'T', 'R', 'C', '1'};
+
+template<typename T>
+T get(const char *&p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+template<typename T>
+void put(char *&p, T value)
+{
+    memcpy(p, &value, sizeof(T));
+    p += sizeof(T);
+}
+
+}; // namespace
+
+TraceLog::TraceLog(const std::string &path) : path(path), scanned(false), valid_end(0) {}
+
+bool TraceLog::exists() const
+{
+    return fs::exists(path);
+}
+
+void TraceLog::read(const std::function<void(const Record &)> &handler)
+{
+    signal_ids.clear();
+    signal_names.clear();
+    valid_end = 0;
+    scanned = true;
+
+    std::ifstream f(path, std::ios::binary);
+    if (f.fail())
+        return;
+
+    char magic[sizeof(trace_log_magic)];
+    f.read(magic, sizeof(magic));
+    if (f.gcount() != sizeof(magic) || memcmp(magic, trace_log_magic, sizeof(magic)) != 0)
+        throw std::runtime_error("invalid trace log " + path);
+
+    valid_end = sizeof(magic);
+    uint64_t file_size = fs::file_size(path);
+
+    std::vector<char> payload;
+
+    // A short or corrupt record is treated as the end of log, so that it is
+    // dropped along with the records after it on next open()
+    while (true) {
+        TraceLogRecordHeader header;
+        f.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (f.gcount() != sizeof(header))
+            break;
+
+        if (header.size > file_size - valid_end - sizeof(header))
+            break;
+
+        payload.resize(header.size);
+        f.read(payload.data(), header.size);
+        if (f.gcount() != header.size)
+            break;
+
+        const char *p = payload.data();
+        Record record;
+        record.type = RecordType(header.type);
+        bool handle = true;
+
+        switch (header.type) {
+            case Signal: {
+                if (header.size < 4)
+                    return;
+                uint32_t id = get<uint32_t>(p);
+                std::string name(p, header.size - sizeof(uint32_t));
+                if (id >= signal_names.size())
+                    signal_names.resize(id + 1);
+                signal_names[id] = name;
+                signal_ids[name] = id;
+                handle = false;
+                break;
+            }
+            case Tick:
+            case Truncate:
+                if (header.size < 8)
+                    return;
+                record.tick = get<uint64_t>(p);
+                break;
+            case Format:
+                if (header.size < 12)
+                    return;
+                record.tick = get<uint64_t>(p);
+                record.format = get<uint32_t>(p);
+                break;
+            case Value: {
+                if (header.size < 24)
+                    return;
+                record.tick = get<uint64_t>(p);
+                uint32_t id = get<uint32_t>(p);
+                get<uint32_t>(p);
+                uint64_t width = get<uint64_t>(p);
+                if (id >= signal_names.size())
+                    return;
+                if (width / 64 + (width % 64 != 0) > (header.size - 24) / sizeof(uint64_t))
+                    return;
+                record.signal = &signal_names[id];
+                record.value = BitVector(width);
+                memcpy(record.value.to_ptr(), p, record.value.blks() * sizeof(uint64_t));
+                break;
+            }
+            default:
+                // Skip unknown records
+                handle = false;
+                break;
+        }
+
+        valid_end += sizeof(header) + header.size;
+
+        if (handle)
+            handler(record);
+    }
+}
+
+void TraceLog::open()
+{
+    if (!scanned)
+        read([](const Record &) {});
+
+    if (valid_end == 0) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        file.write(trace_log_magic, sizeof(trace_log_magic));
+        valid_end = sizeof(trace_log_magic);
+    }
+    else {
+        // Drop the incomplete record at the end
+        fs::resize_file(path, valid_end);
+        file.open(path, std::ios::binary | std::ios::app);
+    }
+
+    if (file.fail())
+        throw std::runtime_error("failed to open trace log " + path);
+}
+
+void TraceLog::append(RecordType type, size_t size)
+{
+    if (!file.is_open())
+        open();
+
+    TraceLogRecordHeader header = {type, uint32_t(size)};
+    memcpy(record_buf.data(), &header, sizeof(header));
+    file.write(record_buf.data(), sizeof(header) + size);
+    valid_end += sizeof(header) + size;
+}
+
+void TraceLog::append_tick(uint64_t tick)
+{
+    record_buf.resize(sizeof(TraceLogRecordHeader) + 8);
+    char *p = record_buf.data() + sizeof(TraceLogRecordHeader);
+    put<uint64_t>(p, tick);
+    append(Tick, 8);
+}
+
+void TraceLog::append_format(uint64_t tick, uint32_t format)
+{
+    record_buf.resize(sizeof(TraceLogRecordHeader) + 12);
+    char *p = record_buf.data() + sizeof(TraceLogRecordHeader);
+    put<uint64_t>(p, tick);
+    put<uint32_t>(p, format);
+    append(Format, 12);
+}
+
+void TraceLog::append_value(const std::string &signal, uint64_t tick, const BitVector &value)
+{
+    if (!file.is_open())
+        open();
+
+    auto it = signal_ids.find(signal);
+    if (it == signal_ids.end()) {
+        uint32_t id = signal_names.size();
+        signal_names.push_back(signal);
+        it = signal_ids.emplace(signal, id).first;
+
+        size_t size = 4 + signal.size();
+        record_buf.resize(sizeof(TraceLogRecordHeader) + size);
+        char *p = record_buf.data() + sizeof(TraceLogRecordHeader);
+        put<uint32_t>(p, id);
+        memcpy(p, signal.data(), signal.size());
+        append(Signal, size);
+    }
+
+    size_t data_size = value.blks() * sizeof(uint64_t);
+    size_t size = 24 + data_size;
+    record_buf.resize(sizeof(TraceLogRecordHeader) + size);
+    char *p = record_buf.data() + sizeof(TraceLogRecordHeader);
+    put<uint64_t>(p, tick);
+    put<uint32_t>(p, it->second);
+    put<uint32_t>(p, 0);
+    put<uint64_t>(p, value.width());
+    memcpy(p, value.to_ptr(), data_size);
+    append(Value, size);
+}
+
+void TraceLog::append_truncate(uint64_t tick)
+{
+    record_buf.resize(sizeof(TraceLogRecordHeader) + 8);
+    char *p = record_buf.data() + sizeof(TraceLogRecordHeader);
+    put<uint64_t>(p, tick);
+    append(Truncate, 8);
+}
+
+void TraceLog::sync()
+{
+    if (!file.is_open())
+        return;
+
+    file.flush();
+    if (file.fail())
+        throw std::runtime_error("failed to write trace log " + path);
+}
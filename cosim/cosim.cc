@@ -1,6 +1,12 @@
 #include "cosim.h"
 
 #include <cstdio>
+#include <cctype>
+#include <cstdlib>
+#include <new>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
 
 #ifdef COSIM_DEBUG
 #define PRINTF printf
@@ -11,64 +17,132 @@
 using namespace boost::interprocess;
 using namespace REMU;
 
-const char *mq_req_name     = "remu_cosim_mq_req";
-const char *mq_resp_name    = "remu_cosim_mq_resp";
 const char *shm_name        = "remu_cosim_shm";
+const char *session_env     = "REMU_COSIM_SESSION";
+
+namespace {
+
+// Size of the control block, rounded up to pages so that the memory area can be sized from the segment
+constexpr size_t channel_size = (sizeof(CosimChannel) + 0xfff) & ~size_t(0xfff);
+
+// Spin first, then back off to sleeping while the other side makes no progress
+template<typename F>
+void wait_until(F cond)
+{
+    for (unsigned int i = 0; !cond(); i++) {
+        if (i < 1024)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(i < 4096 ? 1 : 50));
+    }
+}
+
+};
+
+std::string REMU::cosim_shm_name(const std::string &session)
+{
+    std::string id = session;
+    if (id.empty()) {
+        const char *env = getenv(session_env);
+        if (env)
+            id = env;
+    }
+
+    if (id.empty())
+        return shm_name;
+
+    // The name is used as a file name under /dev/shm
+    for (char c : id)
+        if (!isalnum((unsigned char)c) && c != '_' && c != '-' && c != '.')
+            throw std::invalid_argument("invalid cosim session id " + id);
+
+    return std::string(shm_name) + "_" + id;
+}
 
 void CosimServer::remover::remove()
 {
-    message_queue::remove(mq_req_name);
-    message_queue::remove(mq_resp_name);
-    shared_memory_object::remove(shm_name);
+    shared_memory_object::remove(name.c_str());
 }
 
 bool CosimServer::poll_req(CosimMsgReq &req)
 {
-    unsigned long recvd_size;
-    unsigned int priority;
+    // Drain everything in the ring, so that the BFM does not touch shared state every cycle
+    if (pending_reqs.empty())
+        channel->req.pop_all([this](const CosimMsgReq &r) { pending_reqs.push_back(r); });
+
+    if (pending_reqs.empty())
+        return false;
+
+    req = pending_reqs.front();
+    pending_reqs.pop_front();
 
-    bool result = mq_req.try_receive(
-        &req, sizeof(req), recvd_size, priority);
+    PRINTF("Server recv req: type=%d, addr=0x%x, value=0x%x\n",
+        req.type, req.addr, req.value);
 
-    if (result) {
-        PRINTF("Server recv req: type=%d, addr=0x%x, value=0x%x\n",
-            req.type, req.addr, req.value);
+    if (req.type == RegWritePosted) {
+        req.type = RegWrite;
+        in_flight.push_back({req.id, false});
+    }
+    else if (req.type != Exit) {
+        in_flight.push_back({req.id, true});
     }
 
-    return result;
+    return true;
 }
 
 void CosimServer::send_resp(const CosimMsgResp &resp)
 {
     PRINTF("Server send resp: type=%d, value=0x%x\n",
         resp.type, resp.value);
-    mq_resp.send(&resp, sizeof(resp), 0);
+
+    InFlight cur = {0, true};
+    if (!in_flight.empty()) {
+        cur = in_flight.front();
+        in_flight.pop_front();
+    }
+
+    CosimMsgResp tagged = resp;
+    tagged.id = cur.id;
+
+    if (cur.resp_expected)
+        wait_until([&]() { return channel->resp.try_push(tagged); });
+
+    channel->completed.store(cur.id, std::memory_order_release);
 }
 
-CosimServer::CosimServer(unsigned long mem_size) :
-    mq_req(create_only, mq_req_name, 16, sizeof(CosimMsgReq)),
-    mq_resp(create_only, mq_resp_name, 16, sizeof(CosimMsgResp)),
-    shm(create_only, shm_name, read_write)
+CosimServer::CosimServer(unsigned long mem_size, const std::string &session) :
+    remover_(cosim_shm_name(session)),
+    shm(create_only, remover_.name.c_str(), read_write)
 {
-    shm.truncate(mem_size);
+    if (mem_size % mapped_region::get_page_size() != 0)
+        throw std::invalid_argument("cosim memory size must be a multiple of page size");
+
+    shm.truncate(mem_size + channel_size);
     region = mapped_region(shm, read_write, 0, mem_size);
+    channel_region = mapped_region(shm, read_write, mem_size, channel_size);
+    channel = new (channel_region.get_address()) CosimChannel();
 }
 
-void CosimClient::send_req(const CosimMsgReq &req)
+void CosimClient::send_req(CosimMsgReq req)
 {
+    req.id = req_id(issued + 1);
     PRINTF("Client send req: type=%d, addr=0x%x, value=0x%x\n",
         req.type, req.addr, req.value);
-    mq_req.send(&req, sizeof(req), 0);
+    wait_until([&]() { return channel->req.try_push(req); });
+    issued++;
 }
 
 void CosimClient::recv_resp(CosimMsgResp &resp)
 {
-    unsigned long recvd_size;
-    unsigned int priority;
-
-    mq_resp.receive(&resp, sizeof(resp), recvd_size, priority);
-    PRINTF("Client recv resp: type=%d, value=0x%x\n",
-        resp.type, resp.value);
+    while (true) {
+        wait_until([&]() { return channel->resp.try_pop(resp); });
+        PRINTF("Client recv resp: type=%d, value=0x%x\n",
+            resp.type, resp.value);
+
+        // Drop responses to requests of a previous client
+        if (resp.id >> 32 == tag)
+            break;
+    }
 }
 
 uint32_t CosimClient::reg_read(uint32_t addr)
@@ -77,6 +151,7 @@ uint32_t CosimClient::reg_read(uint32_t addr)
         .type   = RegRead,
         .value  = 0,
         .addr   = addr,
+        .id     = 0,
     };
     send_req(req);
 
@@ -89,24 +164,64 @@ uint32_t CosimClient::reg_read(uint32_t addr)
 void CosimClient::reg_write(uint32_t addr, uint32_t value)
 {
     CosimMsgReq req = {
-        .type   = RegWrite,
+        .type   = RegWritePosted,
         .value  = value,
         .addr   = addr,
+        .id     = 0,
     };
     send_req(req);
+}
 
-    CosimMsgResp resp;
-    recv_resp(resp);
+void CosimClient::reg_read_batch(const uint64_t *addrs, uint32_t *values, size_t count)
+{
+    // No more reads than the ring depth are in flight,
+    // so that the server never blocks on a full response ring
+    size_t sent = 0, recvd = 0;
+    while (recvd < count) {
+        while (sent < count && sent - recvd < cosim_ring_depth) {
+            CosimMsgReq req = {
+                .type   = RegRead,
+                .value  = 0,
+                .addr   = uint32_t(addrs[sent]),
+                .id     = 0,
+            };
+            send_req(req);
+            sent++;
+        }
+
+        CosimMsgResp resp;
+        recv_resp(resp);
+        values[recvd++] = resp.value;
+    }
+}
+
+void CosimClient::reg_write_batch(const uint64_t *addrs, const uint32_t *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        reg_write(addrs[i], values[i]);
+}
+
+void CosimClient::sync()
+{
+    // Requests are processed in order, so the last one sent completes last
+    if (issued != 0)
+        wait_until([&]() { return channel->completed.load(std::memory_order_acquire) == req_id(issued); });
 }
 
-CosimClient::CosimClient() :
-    mq_req(open_only, mq_req_name),
-    mq_resp(open_only, mq_resp_name),
-    shm(open_only, shm_name, read_write)
+CosimClient::CosimClient(const std::string &session) :
+    shm(open_only, cosim_shm_name(session).c_str(), read_write), tag(0), issued(0)
 {
     offset_t size = 0;
     shm.get_size(size);
-    region = mapped_region(shm, read_write, 0, size);
+    if (size < offset_t(channel_size))
+        throw std::runtime_error("invalid cosim shared memory");
+
+    size_t mem_size = size - channel_size;
+    region = mapped_region(shm, read_write, 0, mem_size);
+    channel_region = mapped_region(shm, read_write, mem_size, channel_size);
+    channel = static_cast<CosimChannel *>(channel_region.get_address());
+
+    tag = channel->clients.fetch_add(1, std::memory_order_relaxed) + 1;
 }
 
 CosimClient::~CosimClient()
@@ -115,6 +230,7 @@ CosimClient::~CosimClient()
         .type   = Exit,
         .value  = 0,
         .addr   = 0,
+        .id     = 0,
     };
     send_req(req);
 }
@@ -1,16 +1,22 @@
 #ifndef _COSIM_H_
 #define _COSIM_H_
 
-#include <boost/interprocess/ipc/message_queue.hpp>
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <string>
+
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
 
 namespace REMU {
 
 enum CosimMsgType
 {
-    Exit        = -1,
-    RegRead     = 0,
-    RegWrite    = 1,
+    Exit            = -1,
+    RegRead         = 0,
+    RegWrite        = 1,
+    RegWritePosted  = 2,    // RegWrite without response to the client
 };
 
 struct CosimMsgReq
@@ -18,14 +24,81 @@ struct CosimMsgReq
     CosimMsgType    type;
     uint32_t        value;      // for RegWrite
     uint32_t        addr;
+    uint64_t        id;         // client tag << 32 | sequence number, set by the client
 };
 
 struct CosimMsgResp
 {
     CosimMsgType    type;
     uint32_t        value;      // for RegRead
+    uint64_t        id;         // id of the request, set by the server
+};
+
+// Lock-free single-producer single-consumer ring in shared memory
+template<typename T, uint32_t N>
+struct CosimRing
+{
+    static_assert((N & (N - 1)) == 0, "ring depth must be a power of 2");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "atomic in shared memory must be lock-free");
+
+    alignas(64) std::atomic<uint32_t> head;     // written by producer
+    alignas(64) std::atomic<uint32_t> tail;     // written by consumer
+    T slots[N];
+
+    bool try_push(const T &item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+            return false;
+        slots[h % N] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t)
+            return false;
+        item = slots[t % N];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pop all available items at once
+    template<typename F>
+    size_t pop_all(F func)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t h = head.load(std::memory_order_acquire);
+        for (uint32_t i = t; i != h; i++)
+            func(slots[i % N]);
+        tail.store(h, std::memory_order_release);
+        return h - t;
+    }
+};
+
+constexpr uint32_t cosim_ring_depth = 256;
+
+// Control block placed after the memory area in the shared memory segment
+struct CosimChannel
+{
+    CosimRing<CosimMsgReq, cosim_ring_depth> req;
+    CosimRing<CosimMsgResp, cosim_ring_depth> resp;
+
+    // Number of clients attached so far, which gives each client its tag
+    alignas(64) std::atomic<uint32_t> clients;
+
+    // Id of the last request processed by the server, including posted writes
+    alignas(64) std::atomic<uint64_t> completed;
 };
 
+// Name of the shared memory object for a co-simulation session
+//
+// If session is empty, it is taken from the environment variable
+// REMU_COSIM_SESSION. An empty session uses the legacy name.
+std::string cosim_shm_name(const std::string &session);
+
 class CosimMemReadWrite
 {
 protected:
@@ -62,38 +135,70 @@ class CosimServer : public CosimMemReadWrite
 {
     struct remover
     {
+        std::string name;
         void remove();
-        remover() { remove(); }
+        remover(const std::string &name) : name(name) { remove(); }
         ~remover() { remove(); }
     } remover_;
 
-    boost::interprocess::message_queue mq_req;
-    boost::interprocess::message_queue mq_resp;
     boost::interprocess::shared_memory_object shm;
+    boost::interprocess::mapped_region channel_region;
+    CosimChannel *channel;
+
+    // Requests drained from the ring but not yet processed by the BFM
+    std::deque<CosimMsgReq> pending_reqs;
+
+    // Requests being processed by the BFM
+    struct InFlight
+    {
+        uint64_t id;
+        bool resp_expected;     // whether a response is sent to the client
+    };
+    std::deque<InFlight> in_flight;
 
 public:
 
+    // Posted writes are reported as RegWrite, and their responses are dropped
     bool poll_req(CosimMsgReq &req);
     void send_resp(const CosimMsgResp &resp);
 
-    CosimServer(unsigned long mem_size);
+    CosimServer(unsigned long mem_size, const std::string &session = "");
 };
 
 class CosimClient : public CosimMemReadWrite
 {
-    boost::interprocess::message_queue mq_req;
-    boost::interprocess::message_queue mq_resp;
     boost::interprocess::shared_memory_object shm;
+    boost::interprocess::mapped_region channel_region;
+    CosimChannel *channel;
+
+    // Requests & responses of previous clients, which may still be in the
+    // rings, are told apart by the tag in their ids
+    uint32_t tag;
+
+    // Number of requests sent, including posted writes
+    uint64_t issued;
+
+    uint64_t req_id(uint64_t seq) const { return uint64_t(tag) << 32 | (seq & 0xffffffff); }
 
-    void send_req(const CosimMsgReq &req);
+    void send_req(CosimMsgReq req);
     void recv_resp(CosimMsgResp &resp);
 
 public:
 
     uint32_t reg_read(uint32_t addr);
+
+    // Register writes are posted, i.e. they do not wait for completion.
+    // Requests are processed in order, so a later read observes them.
     void reg_write(uint32_t addr, uint32_t value);
 
-    CosimClient();
+    // Pipelined register accesses, with requests kept in flight up to the ring depth
+    void reg_read_batch(const uint64_t *addrs, uint32_t *values, size_t count);
+    void reg_write_batch(const uint64_t *addrs, const uint32_t *values, size_t count);
+
+    // Wait until all requests sent have been processed
+    void sync();
+
+    CosimClient(const std::string &session = "");
     ~CosimClient();
 };
 
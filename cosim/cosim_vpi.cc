@@ -2,11 +2,27 @@
 #include "vpi_utils.h"
 
 #include <memory>
+#include <string>
+#include <cstring>
 
 using namespace REMU;
 
 std::unique_ptr<CosimServer> server;
 
+// Session id given by "-cosim-session <id>" in vvp extended arguments
+std::string get_session()
+{
+    s_vpi_vlog_info vlog_info;
+    if (!vpi_get_vlog_info(&vlog_info))
+        return "";
+
+    for (int i = 0; i + 1 < vlog_info.argc; i++)
+        if (!strcmp(vlog_info.argv[i], "-cosim-session"))
+            return vlog_info.argv[i + 1];
+
+    return "";
+}
+
 // function integer $cosim_new(input [63:0] mem_size)
 int cosim_new_calltf(char*)
 {
@@ -20,8 +36,16 @@ int cosim_new_calltf(char*)
     }
 
     auto mem_size = vpiGetValue<uint64_t>(args[0]);
-    if (!server)
-        server = std::make_unique<CosimServer>(mem_size);
+    if (!server) {
+        try {
+            server = std::make_unique<CosimServer>(mem_size, get_session());
+        }
+        catch (std::exception &e) {
+            vpi_printf("%s: %s\n", __func__, e.what());
+            vpiSetValue(callh, -1);
+            return 0;
+        }
+    }
 
     vpiSetValue(callh, 0);
     return 0;
@@ -137,6 +161,7 @@ int cosim_send_resp_calltf(char*)
     CosimMsgResp resp = {
         .type   = vpiGetValue<int>(args[0]) ? RegWrite : RegRead,
         .value  = vpiGetValue<uint32_t>(args[1]),
+        .id     = 0,
     };
     server->send_resp(resp);
 
@@ -28,6 +28,17 @@ bool Driver::cmd_help(const std::vector<std::string> &args)
         "        be removed.\n"
         "    ckpt_interval [<interval>]\n"
         "        Get/set checkpoint interval\n"
+        "    ckpt_format [raw|delta|dedup|compressed]\n"
+        "        Get/set memory image format of new checkpoints. Delta images only\n"
+        "        store pages changed since the previous checkpoint. Dedup images\n"
+        "        store each distinct chunk once across all checkpoints. Compressed\n"
+        "        images store zlib-compressed blocks with zero blocks as holes.\n"
+        "    ckpt_export <file>\n"
+        "        Export checkpointed ticks & signal traces in JSON, or in portable\n"
+        "        binary if <file> ends with .bin.\n"
+        "    ckpt_async [<depth>]\n"
+        "        Get/set maximum number of checkpoints written in background.\n"
+        "        0 (default) means checkpoints are written before emulation continues.\n"
         "    run [<tick>]\n"
         "        Run emulation (to the specified tick).\n"
         "    trigger\n"
@@ -100,6 +111,9 @@ bool Driver::cmd_replay_record(const std::vector<std::string> &args)
     bool record = args[0] == "record";
 
     uint64_t tick = std::stoul(args[1]);
+
+    // Failed checkpoints being written in background are discarded first
+    commit_checkpoints(true);
     cur_tick = ckpt_mgr.find_latest(tick);
 
     if (record) {
@@ -130,6 +144,63 @@ bool Driver::cmd_ckpt_interval(const std::vector<std::string> &args)
     return false;
 }
 
+bool Driver::cmd_ckpt_export(const std::vector<std::string> &args)
+{
+    if (args.size() != 2) {
+        fprintf(stderr, "Incorrect number of arguments for this command\n");
+        return false;
+    }
+
+    ckpt_mgr.export_metadata(args[1]);
+    return true;
+}
+
+bool Driver::cmd_ckpt_async(const std::vector<std::string> &args)
+{
+    if (args.size() == 1) {
+        printf("Checkpoint async depth: %lu\n", ckpt_writer.get_max_pending());
+        return true;
+    }
+
+    if (args.size() == 2) {
+        ckpt_writer.set_max_pending(std::stoul(args[1]));
+        return true;
+    }
+
+    fprintf(stderr, "Incorrect number of arguments for this command\n");
+    return false;
+}
+
+bool Driver::cmd_ckpt_format(const std::vector<std::string> &args)
+{
+    static const std::unordered_map<std::string, CheckpointFormat> formats = {
+        {"raw",         CheckpointFormat::Raw},
+        {"delta",       CheckpointFormat::Delta},
+        {"dedup",       CheckpointFormat::Dedup},
+        {"compressed", CheckpointFormat::Compressed},
+    };
+
+    if (args.size() == 1) {
+        for (auto &it : formats)
+            if (it.second == ckpt_mgr.format)
+                printf("Checkpoint format: %s\n", it.first.c_str());
+        return true;
+    }
+
+    if (args.size() == 2) {
+        auto it = formats.find(args[1]);
+        if (it == formats.end()) {
+            fprintf(stderr, "Unknown checkpoint format %s\n", args[1].c_str());
+            return false;
+        }
+        ckpt_mgr.format = it->second;
+        return true;
+    }
+
+    fprintf(stderr, "Incorrect number of arguments for this command\n");
+    return false;
+}
+
 bool Driver::cmd_run(const std::vector<std::string> &args)
 {
     if (args.size() == 1) {
@@ -330,6 +401,9 @@ decltype(Driver::cmd_dispatcher) Driver::cmd_dispatcher = {
     {"replay",          &Driver::cmd_replay_record},
     {"record",          &Driver::cmd_replay_record},
     {"ckpt_interval",   &Driver::cmd_ckpt_interval},
+    {"ckpt_format",     &Driver::cmd_ckpt_format},
+    {"ckpt_export",     &Driver::cmd_ckpt_export},
+    {"ckpt_async",      &Driver::cmd_ckpt_async},
     {"run",             &Driver::cmd_run},
     {"trigger",         &Driver::cmd_trigger},
     {"signal",          &Driver::cmd_signal},
@@ -20,11 +20,26 @@ namespace {
 
 #define FROM_NODE(t, v) auto v = node[#v].as<t>();
 
+// Accept either a single string or a list of strings
+std::vector<std::string> as_string_list(const YAML::Node &node)
+{
+    std::vector<std::string> res;
+    if (node.IsSequence()) {
+        for (auto &item : node)
+            res.push_back(item.as<std::string>());
+    }
+    else {
+        res.push_back(node.as<std::string>());
+    }
+    return res;
+}
+
 const std::unordered_map<std::string,
     std::function<std::unique_ptr<UserMem>(const YAML::Node &)>> mem_type_funcs = {
 #ifdef ENABLE_COSIM
     {"cosim",   [](const YAML::Node &node) {
-        return std::make_unique<CosimUserMem>();
+        auto session = node["session"] ? node["session"].as<std::string>() : "";
+        return std::make_unique<CosimUserMem>(session);
     }},
 #endif
     {"devmem",  [](const YAML::Node &node) {
@@ -44,8 +59,8 @@ const std::unordered_map<std::string,
     {"pcie-dma",    [](const YAML::Node &node) {
         FROM_NODE(uint64_t, base)
         FROM_NODE(uint64_t, size)
-        FROM_NODE(std::string, c2h)
-        FROM_NODE(std::string, h2c)
+        auto c2h = as_string_list(node["c2h"]);
+        auto h2c = as_string_list(node["h2c"]);
         return std::make_unique<PCIeDMAUserMem>(base, size, c2h, h2c);
     }},
     {"pcie-bar",    [](const YAML::Node &node) {
@@ -63,7 +78,8 @@ const std::unordered_map<std::string,
     std::function<std::unique_ptr<UserIO>(const YAML::Node &)>> reg_type_funcs = {
 #ifdef ENABLE_COSIM
     {"cosim",   [](const YAML::Node &node) {
-        return std::make_unique<CosimUserIO>();
+        auto session = node["session"] ? node["session"].as<std::string>() : "";
+        return std::make_unique<CosimUserIO>(session);
     }},
 #endif
     {"devmem",  [](const YAML::Node &node) {
@@ -115,6 +131,23 @@ void Controller::init_uma(const YAML::Node &platinfo)
     reg = create_uma_reg(platinfo["reg"]);
 }
 
+void Controller::init_irq(const YAML::Node &platinfo)
+{
+    auto node = platinfo["irq"];
+    if (!node) {
+        waiter = std::make_unique<EventWaiter>();
+        return;
+    }
+
+    auto type = node["type"].as<std::string>();
+    if (type != "uio") {
+        fprintf(stderr, "PlatInfo error: irq type %s is not supported\n", type.c_str());
+        throw std::runtime_error("bad platinfo");
+    }
+
+    waiter = std::make_unique<EventWaiter>(node["dev"].as<std::string>());
+}
+
 bool Controller::is_run_mode()
 {
     return reg->read(RegDef::MODE_CTRL) & RegDef::MODE_CTRL_RUN_MODE;
@@ -202,29 +235,52 @@ void Controller::do_scan(bool scan_in)
 BitVector Controller::get_signal_value(const RTSignal &signal)
 {
     int nblks = (signal.width + 31) / 32;
+    std::vector<uint64_t> offsets(nblks);
+    std::vector<uint32_t> values(nblks);
+    for (int i = 0; i < nblks; i++)
+        offsets[i] = signal.reg_offset + i * 4;
+
+    reg->read_batch(offsets.data(), values.data(), nblks);
+
     BitVector res(signal.width);
     for (int i = 0; i < nblks; i++) {
         int offset = i * 32;
         int width = std::min(signal.width - offset, 32);
-        res.setValue(offset, width, reg->read(signal.reg_offset + i * 4));
+        res.setWord(offset, width, values[i]);
     }
     return res;
 }
 
 void Controller::set_signal_value(const RTSignal &signal, const BitVector &value)
 {
-    if (signal.output)
-        return;
-
-    if (value.width() != signal.width)
-        throw std::invalid_argument("value width mismatch");
+    set_signal_values({{&signal, &value}});
+}
 
-    int nblks = (signal.width + 31) / 32;
-    for (int i = 0; i < nblks; i++) {
-        int offset = i * 32;
-        int width = std::min(signal.width - offset, 32);
-        reg->write(signal.reg_offset + i * 4, value.getValue(offset, width));
+void Controller::set_signal_values(const std::vector<std::pair<const RTSignal *, const BitVector *>> &signals)
+{
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> values;
+
+    for (auto &it : signals) {
+        auto &signal = *it.first;
+        auto &value = *it.second;
+
+        if (signal.output)
+            continue;
+
+        if (value.width() != signal.width)
+            throw std::invalid_argument("value width mismatch");
+
+        int nblks = (signal.width + 31) / 32;
+        for (int i = 0; i < nblks; i++) {
+            int offset = i * 32;
+            int width = std::min(signal.width - offset, 32);
+            offsets.push_back(signal.reg_offset + i * 4);
+            values.push_back(value.getWord(offset, width));
+        }
     }
+
+    reg->write_batch(offsets.data(), values.data(), offsets.size());
 }
 
 bool Controller::is_trigger_active(const RTTrigger &trigger)
@@ -236,6 +292,24 @@ bool Controller::is_trigger_active(const RTTrigger &trigger)
     return value & (1 << offset);
 }
 
+std::vector<uint32_t> Controller::get_active_trigger_mask(int num_triggers)
+{
+    int nwords = (num_triggers + 31) / 32;
+    std::vector<uint64_t> offsets(nwords * 2);
+    std::vector<uint32_t> values(nwords * 2);
+    for (int i = 0; i < nwords; i++) {
+        offsets[i] = RegDef::TRIG_STAT_START + i * 4;
+        offsets[nwords + i] = RegDef::TRIG_EN_START + i * 4;
+    }
+
+    reg->read_batch(offsets.data(), values.data(), offsets.size());
+
+    std::vector<uint32_t> mask(nwords);
+    for (int i = 0; i < nwords; i++)
+        mask[i] = values[i] & values[nwords + i];
+    return mask;
+}
+
 bool Controller::get_trigger_enable(const RTTrigger &trigger)
 {
     int id = trigger.reg_index;
@@ -13,6 +13,7 @@
 #include "runtime_data.h"
 #include "checkpoint.h"
 #include "uma.h"
+#include "event_wait.h"
 
 namespace REMU {
 
@@ -20,12 +21,15 @@ class Controller
 {
     std::unique_ptr<UserMem> mem;
     std::unique_ptr<UserIO> reg;
+    std::unique_ptr<EventWaiter> waiter;
 
     void init_uma(const YAML::Node &platinfo);
+    void init_irq(const YAML::Node &platinfo);
 
 public:
 
     std::unique_ptr<UserMem> const& memory() const { return mem; }
+    EventWaiter& events() { return *waiter; }
 
     bool is_run_mode();
     void enter_run_mode();
@@ -44,7 +48,14 @@ public:
     BitVector get_signal_value(const RTSignal &signal);
     void set_signal_value(const RTSignal &signal, const BitVector &value);
 
+    // Set values of multiple signals in one batch
+    void set_signal_values(const std::vector<std::pair<const RTSignal *, const BitVector *>> &signals);
+
     bool is_trigger_active(const RTTrigger &trigger);
+
+    // Read TRIG_STAT & TRIG_EN banks in one batch, and return masks of
+    // triggers which are both active and enabled, 32 triggers per word
+    std::vector<uint32_t> get_active_trigger_mask(int num_triggers);
     bool get_trigger_enable(const RTTrigger &trigger);
     bool get_trace_full();
 
@@ -59,6 +70,7 @@ public:
     Controller(const SysInfo &sysinfo, const YAML::Node &platinfo)
     {
         init_uma(platinfo);
+        init_irq(platinfo);
     }
 };
 
@@ -8,10 +8,13 @@
 #include <chrono>
 #include <string>
 
+#include <unistd.h>
+
 #include "regdef.h"
 #include "uart.h"
 #include "emu_utils.h"
 #include "sighandler.h"
+#include "restore.h"
 
 using namespace REMU;
 
@@ -147,8 +150,46 @@ void Driver::init_trace(const SysInfo &sysinfo)
     }
 }
 
+void Driver::init_trigger()
+{
+    for (int index = 0; index < trigger_db.count(); index++) {
+        int reg_index = trigger_db.object_by_index(index).reg_index;
+        if (reg_index >= int(trigger_by_reg_index.size()))
+            trigger_by_reg_index.resize(reg_index + 1, -1);
+        trigger_by_reg_index[reg_index] = index;
+    }
+}
+
+void Driver::commit_checkpoints(bool wait)
+{
+    if (wait)
+        ckpt_writer.drain();
+
+    for (auto &result : ckpt_writer.take_results()) {
+        if (!result.error) {
+            ckpt_mgr.commit(result.tick);
+            continue;
+        }
+
+        try {
+            std::rethrow_exception(result.error);
+        }
+        catch (std::exception &e) {
+            fprintf(stderr, "[REMU] ERROR: Failed to save checkpoint @ tick %lu: %s\n", result.tick, e.what());
+        }
+
+        ckpt_mgr.discard(result.tick);
+    }
+
+    ckpt_mgr.flush();
+}
+
 void Driver::load_checkpoint()
 {
+    // Checkpoints being written in background must be complete before loading
+
+    commit_checkpoints(true);
+
     if (!ckpt_mgr.has_tick(cur_tick)) {
         fprintf(stderr, "[REMU] ERROR: Checkpoint for tick %lu does not exist\n", cur_tick);
         return;
@@ -170,6 +211,7 @@ void Driver::load_checkpoint()
 
         // Restore signals
 
+        std::vector<std::pair<const RTSignal *, const BitVector *>> values;
         for (auto &signal : signal_db.objects()) {
             if (signal.output)
                 continue;
@@ -181,20 +223,22 @@ void Driver::load_checkpoint()
                 throw std::runtime_error("failed to find current signal value in trace");
 
             --it;
-            ctrl.set_signal_value(signal, it->second);
+            values.push_back({&signal, &it->second});
         }
+        ctrl.set_signal_values(values);
 
         // Load memory regions
 
         {
             Profiler profiler(this, "load memory");
+            RestoreEngine restore(*ctrl.memory());
             for (auto &axi : axi_db.objects()) {
                 if(axi.size == 0)
                     continue;
-                auto stream = ckpt.axi_mems.at(axi.name).read();
                 fprintf(stderr, "[REMU] INFO: Start loading memory at %lx size = %lx\n", axi.assigned_offset, axi.assigned_size);
-                ctrl.memory()->copy_from_stream(axi.assigned_offset, axi.assigned_size, stream);
+                restore.add(axi.assigned_offset, axi.assigned_size, ckpt.axi_mems.at(axi.name).read());
             }
+            restore.run();
         }
 
         // Load design state
@@ -205,19 +249,26 @@ void Driver::load_checkpoint()
         }
     }
 
+    replay_schedule = ReplaySchedule();
+
     if (is_replay_mode()) {
-        // Setup trace replay queue
+        // Setup trace replay schedule
+        auto &events = replay_schedule.events;
         for (auto &signal : signal_db.objects()) {
             if (signal.output)
                 continue;
 
-            signal.trace_replay_q = decltype(signal.trace_replay_q)();
             for (auto it = signal.trace.lower_bound(cur_tick); 
                     it != signal.trace.end(); ++it) {
-                signal.trace_replay_q.push(*it);
+                events.push_back({it->first, &signal, it->second});
             }
         }
 
+        std::stable_sort(events.begin(), events.end(),
+            [](const ReplaySchedule::Event &a, const ReplaySchedule::Event &b) {
+                return a.tick < b.tick;
+            });
+
         // Stop at end of trace in replay mode
         meta_event_q.push({ckpt_mgr.last_tick(), Stop});
     }
@@ -235,7 +286,14 @@ void Driver::save_checkpoint()
     {
         Profiler profiler(this, "save checkpoint total");
 
-        auto ckpt = ckpt_mgr.open(cur_tick);
+        if (ckpt_writer.is_async()) {
+            Profiler profiler(this, "wait for background writer");
+            ckpt_writer.wait_slot();
+        }
+
+        commit_checkpoints(false);
+
+        auto ckpt = std::make_unique<Checkpoint>(ckpt_mgr.open(cur_tick));
 
         // Save design state
 
@@ -246,13 +304,35 @@ void Driver::save_checkpoint()
 
         // Save memory regions
 
-        {
+        if (ckpt_writer.is_async()) {
+            // Copy memory regions to host buffers, which are written to disk in background
             Profiler profiler(this, "save memory");
+            CheckpointWriter::Images images;
             for (auto &axi : axi_db.objects()) {
                 if(axi.size == 0)
                     continue;
-                auto stream = ckpt.axi_mems.at(axi.name).write();
+                auto buffer = ckpt_writer.alloc_buffer(axi.assigned_size);
+                HostBufferOStream stream(*buffer);
                 ctrl.memory()->copy_to_stream(axi.assigned_offset, axi.assigned_size, stream);
+                images[axi.name] = std::move(buffer);
+            }
+            // The checkpoint is logged after its images are written
+            ckpt_mgr.defer(cur_tick);
+            ckpt_writer.submit(cur_tick, std::move(ckpt), std::move(images));
+        }
+        else {
+            Profiler profiler(this, "save memory");
+            for (auto &axi : axi_db.objects()) {
+                if(axi.size == 0)
+                    continue;
+                auto stream = ckpt->axi_mems.at(axi.name).write();
+                ctrl.memory()->copy_to_stream(axi.assigned_offset, axi.assigned_size, *stream);
+                if (!stream->finish()) {
+                    fprintf(stderr, "[REMU] ERROR: Failed to save checkpoint @ tick %lu: failed to write memory image %s\n",
+                        cur_tick, axi.name.c_str());
+                    ckpt_mgr.discard(cur_tick);
+                    return;
+                }
             }
         }
 
@@ -273,16 +353,20 @@ bool Driver::handle_event()
 {
     bool stop_requested = false;
 
-    for (int index = 0; index < trigger_db.count(); index++) {
-        auto &trigger = trigger_db.object_by_index(index);
+    auto mask = ctrl.get_active_trigger_mask(trigger_by_reg_index.size());
+    for (size_t word = 0; word < mask.size(); word++) {
+        for (uint32_t bits = mask[word]; bits != 0; bits &= bits - 1) {
+            size_t reg_index = word * 32 + __builtin_ctz(bits);
+            if (reg_index >= trigger_by_reg_index.size() || trigger_by_reg_index[reg_index] < 0)
+                continue;
 
-        if (!ctrl.get_trigger_enable(trigger) || !ctrl.is_trigger_active(trigger))
-            continue;
+            auto &trigger = trigger_db.object_by_index(trigger_by_reg_index[reg_index]);
 
-        fprintf(stderr, "[REMU] INFO: Tick %lu: trigger \"%s\" is activated\n",
-            cur_tick, trigger.name.c_str());
+            fprintf(stderr, "[REMU] INFO: Tick %lu: trigger \"%s\" is activated\n",
+                cur_tick, trigger.name.c_str());
 
-        stop_requested = true;
+            stop_requested = true;
+        }
     }
 
     if(ctrl.get_trace_full()){
@@ -316,18 +400,16 @@ bool Driver::handle_event()
     // Process trace replay
 
     if (is_replay_mode()) {
-        for (auto &signal : signal_db.objects()) {
-            auto &q = signal.trace_replay_q;
-            while (!q.empty()) {
-                auto next_tick = q.front().first;
-
-                if (next_tick > cur_tick)
-                    break;
-
-                ctrl.set_signal_value(signal, q.front().second);
-                q.pop();
-            }
+        // Write all changes of this tick in one batch
+        std::vector<std::pair<const RTSignal *, const BitVector *>> values;
+        auto &sched = replay_schedule;
+        while (!sched.empty() && sched.next_tick() <= cur_tick) {
+            auto &event = sched.events[sched.next++];
+            values.push_back({event.signal, &event.value});
         }
+
+        if (!values.empty())
+            ctrl.set_signal_values(values);
     }
 
     return stop_requested;
@@ -351,18 +433,13 @@ uint32_t Driver::calc_next_event_step()
 
     // Process trace replay
 
-    if (is_replay_mode()) {
-        for (auto &signal : signal_db.objects()) {
-            auto &q = signal.trace_replay_q;
-            if (!q.empty()) {
-                auto next_tick = q.front().first;
+    if (is_replay_mode() && !replay_schedule.empty()) {
+        auto next_tick = replay_schedule.next_tick();
 
-                if (next_tick < cur_tick)
-                    throw std::runtime_error("executing event behind current tick");
+        if (next_tick < cur_tick)
+            throw std::runtime_error("executing event behind current tick");
 
-                step = std::min(step, next_tick - cur_tick);
-            }
-        }
+        step = std::min(step, next_tick - cur_tick);
     }
 
     return step;
@@ -396,6 +473,12 @@ void Driver::run()
     if (uart)
         uart->enter_term();
 
+    // Wake up on UART input from terminal
+    auto &events = ctrl.events();
+    bool watch_stdin = uart && !is_replay_mode() && isatty(0);
+    if (watch_stdin)
+        events.watch(0);
+
     {
         Profiler profiler(this, "run emulation");
         while (!break_flag) {
@@ -405,12 +488,15 @@ void Driver::run()
                 ctrl.enter_run_mode();
             }
 
+            events.reset();
             while (is_running()) {
-                if (uart)
-                    uart->poll(*this);
+                if (uart && uart->poll(*this))
+                    events.reset();
 
                 if (break_flag)
                     ctrl.exit_run_mode();
+                else
+                    events.wait();
             }
 
             cur_tick = ctrl.get_tick_count();
@@ -421,6 +507,9 @@ void Driver::run()
         fprintf(stderr, "\n");
     }
 
+    if (watch_stdin)
+        events.unwatch(0);
+
     if (uart)
         uart->exit_term();
 }
@@ -432,6 +521,7 @@ Driver::Driver(
 ) :
     options(options),
     ckpt_mgr(sysinfo, options.ckpt_path),
+    ckpt_writer(0),
     ctrl(sysinfo, platinfo),
     signal_db(sysinfo.signal),
     trigger_db(sysinfo.trigger),
@@ -440,4 +530,10 @@ Driver::Driver(
     init_axi(sysinfo);
     init_model(sysinfo);
     init_trace(sysinfo);
+    init_trigger();
+}
+
+Driver::~Driver()
+{
+    commit_checkpoints(true);
 }
@@ -12,6 +12,7 @@
 
 #include "runtime_data.h"
 #include "checkpoint.h"
+#include "checkpoint_writer.h"
 #include "controller.h"
 #include "uart.h"
 #include "rammodel.h"
@@ -28,11 +29,15 @@ class Driver
     DriverParameters options;
     Controller ctrl;
     CheckpointManager ckpt_mgr;
+    CheckpointWriter ckpt_writer;
 
     RTDatabase<RTSignal> signal_db;
     RTDatabase<RTTrigger> trigger_db;
     RTDatabase<RTAXI> axi_db;
 
+    // trigger register index -> trigger index in trigger_db, or -1
+    std::vector<int> trigger_by_reg_index;
+
     std::unique_ptr<UartModel> uart;
     std::unordered_map<std::string, std::unique_ptr<RamModel>> rammodel;
     std::vector<std::string> trace_ports;
@@ -54,6 +59,8 @@ class Driver
 
     std::priority_queue<MetaEvent, std::vector<MetaEvent>, std::greater<MetaEvent>> meta_event_q;
 
+    ReplaySchedule replay_schedule;
+
     uint64_t ckpt_interval = 0;
     uint32_t trace_reg_base = 0x5000;
 
@@ -61,10 +68,15 @@ class Driver
     void init_model(const SysInfo &sysinfo);
     void init_perf(const std::string &file, uint64_t interval);
     void init_trace(const SysInfo &sysinfo);
+    void init_trigger();
 
     BitVector get_signal_value(RTSignal &signal);
     void set_signal_value(RTSignal &signal, const BitVector &value);
 
+    // Log checkpoints written in background, and discard the failed ones.
+    // If wait is true, wait for all checkpoints being written first.
+    void commit_checkpoints(bool wait);
+
     void load_checkpoint();
     void save_checkpoint();
 
@@ -81,6 +93,9 @@ class Driver
     bool cmd_save           (const std::vector<std::string> &args);
     bool cmd_replay_record  (const std::vector<std::string> &args);
     bool cmd_ckpt_interval  (const std::vector<std::string> &args);
+    bool cmd_ckpt_format    (const std::vector<std::string> &args);
+    bool cmd_ckpt_export    (const std::vector<std::string> &args);
+    bool cmd_ckpt_async     (const std::vector<std::string> &args);
     bool cmd_record         (const std::vector<std::string> &args);
     bool cmd_run            (const std::vector<std::string> &args);
     bool cmd_trigger        (const std::vector<std::string> &args);
@@ -146,6 +161,8 @@ public:
         const DriverParameters &options
     );
 
+    ~Driver();
+
     Driver(const Driver &) = delete;
     Driver& operator=(const Driver &) = delete;
 };
@@ -0,0 +1,96 @@
+#include "event_wait.h"
+
+#include <cerrno>
+#include <algorithm>
+#include <system_error>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace REMU;
+
+EventWaiter::EventWaiter(const std::string &uio_dev) : irq_fd(-1), interval_ns(min_interval_ns)
+{
+    if (uio_dev.empty())
+        return;
+
+    irq_fd = open(uio_dev.c_str(), O_RDWR | O_CLOEXEC);
+    if (irq_fd < 0)
+        throw std::system_error(errno, std::generic_category(), "failed to open " + uio_dev);
+
+    enable_irq();
+}
+
+EventWaiter::~EventWaiter()
+{
+    if (irq_fd >= 0)
+        close(irq_fd);
+}
+
+void EventWaiter::enable_irq()
+{
+    // UIO interrupts are masked after being delivered, until 1 is written
+    uint32_t enable = 1;
+    if (::write(irq_fd, &enable, sizeof(enable)) != sizeof(enable))
+        throw std::system_error(errno, std::generic_category(), "failed to enable uio interrupt");
+}
+
+void EventWaiter::watch(int fd)
+{
+    if (std::find(watched_fds.begin(), watched_fds.end(), fd) == watched_fds.end())
+        watched_fds.push_back(fd);
+}
+
+void EventWaiter::unwatch(int fd)
+{
+    watched_fds.erase(std::remove(watched_fds.begin(), watched_fds.end(), fd), watched_fds.end());
+}
+
+void EventWaiter::wait()
+{
+    std::vector<struct pollfd> fds;
+
+    if (irq_fd >= 0)
+        fds.push_back({irq_fd, POLLIN, 0});
+
+    for (int fd : watched_fds)
+        fds.push_back({fd, POLLIN, 0});
+
+    struct timespec timeout = {
+        .tv_sec     = time_t(interval_ns / 1000000000),
+        .tv_nsec    = long(interval_ns % 1000000000),
+    };
+
+    int ret = ppoll(fds.data(), fds.size(), &timeout, nullptr);
+
+    // Interrupted by a signal, which is handled by the caller
+    if (ret < 0 && errno == EINTR)
+        return;
+
+    if (ret < 0)
+        throw std::system_error(errno, std::generic_category(), "failed to wait for events");
+
+    if (ret == 0) {
+        interval_ns = std::min(interval_ns * 2, max_interval_ns);
+        return;
+    }
+
+    size_t first_watched = 0;
+
+    if (irq_fd >= 0) {
+        if (fds[0].revents & POLLIN) {
+            uint32_t count;
+            if (::read(irq_fd, &count, sizeof(count)) == sizeof(count))
+                enable_irq();
+        }
+        first_watched = 1;
+    }
+
+    // Stop watching closed descriptors, which would otherwise end every wait
+    for (size_t i = first_watched; i < fds.size(); i++)
+        if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+            unwatch(fds[i].fd);
+
+    reset();
+}
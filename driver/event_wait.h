@@ -0,0 +1,52 @@
+#ifndef _REMU_EVENT_WAIT_H_
+#define _REMU_EVENT_WAIT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace REMU {
+
+// Wait for emulator events while running
+//
+// If the platform provides a UIO device for the emulator interrupt, waiting
+// blocks on it. The interrupt may not cover every event (e.g. UART output),
+// so waiting is also bounded by a polling interval, which starts small and
+// grows while nothing happens. Watched file descriptors (e.g. stdin for UART
+// input) also end the wait when they become readable.
+
+class EventWaiter
+{
+    int irq_fd;
+    std::vector<int> watched_fds;
+
+    uint64_t interval_ns;
+
+    static constexpr uint64_t min_interval_ns = 1000;
+    static constexpr uint64_t max_interval_ns = 1000000;
+
+    void enable_irq();
+
+public:
+
+    bool has_irq() const { return irq_fd >= 0; }
+
+    void watch(int fd);
+    void unwatch(int fd);
+
+    // Restart from the minimum polling interval after activity
+    void reset() { interval_ns = min_interval_ns; }
+
+    void wait();
+
+    // uio_dev is empty if no interrupt is available
+    EventWaiter(const std::string &uio_dev = "");
+    ~EventWaiter();
+
+    EventWaiter(const EventWaiter &) = delete;
+    EventWaiter& operator=(const EventWaiter &) = delete;
+};
+
+};
+
+#endif
@@ -28,6 +28,8 @@ void show_help(const char * argv_0)
         "Usage: %s <sysinfo_file> <platinfo_file> <checkpoint_path> [options] [commands]\n"
         "\n"
         "    You can specify \"@cosim\" as <platinfo_file> for co-simulation (if enabled).\n"
+        "    Use \"@cosim:<session>\" to connect to the simulator started with\n"
+        "    \"-cosim-session <session>\", or set REMU_COSIM_SESSION for both.\n"
         "\n"
         "Options:\n"
         "    --batch\n"
@@ -69,6 +71,9 @@ int main(int argc, const char *argv[])
 
     std::vector<std::string> commands(argv + argidx, argv + argc);
 
+    // Signal traces and circuit states hold many wide vectors
+    BitVectorUtils::set_pool_enabled(true);
+
     SysInfo sysinfo;
     YAML::Node platinfo;
 
@@ -81,9 +86,14 @@ int main(int argc, const char *argv[])
         sysinfo = SysInfo::fromJson(f);
     }
 
-    if (platinfo_file == "@cosim") {
+    if (platinfo_file == "@cosim" || platinfo_file.rfind("@cosim:", 0) == 0) {
         platinfo["mem"]["type"] = "cosim";
         platinfo["reg"]["type"] = "cosim";
+        if (platinfo_file.size() > 7) {
+            std::string session = platinfo_file.substr(7);
+            platinfo["mem"]["session"] = session;
+            platinfo["reg"]["session"] = session;
+        }
     }
     else {
         std::ifstream f(platinfo_file);
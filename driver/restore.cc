@@ -0,0 +1,192 @@
+#include "restore.h"
+
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+using namespace REMU;
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+class SliceIStream : public std::istream
+{
+    class Buf : public std::streambuf
+    {
+    public:
+        Buf(char *data, size_t size) { setg(data, data, data + size); }
+    } buf;
+
+public:
+
+    SliceIStream(char *data, size_t size) :
+        std::istream(nullptr), buf(data, size)
+    {
+        rdbuf(&buf);
+    }
+};
+
+};
+
+void RestoreEngine::add(uint64_t offset, uint64_t len, std::unique_ptr<std::istream> stream)
+{
+    regions.push_back({offset, len, std::move(stream)});
+}
+
+void RestoreEngine::reader()
+{
+    try {
+        while (true) {
+            Region *region;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (error || next_region >= regions.size())
+                    break;
+                region = &regions[next_region++];
+            }
+
+            uint64_t done = 0;
+            while (done < region->len) {
+                std::unique_ptr<Slice> slice;
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cond.wait(lock, [this]() { return error || !free_slices.empty(); });
+                    if (error)
+                        break;
+                    slice = std::move(free_slices.back());
+                    free_slices.pop_back();
+                }
+
+                auto start = std::chrono::steady_clock::now();
+
+                uint64_t n = std::min<uint64_t>(slice_size, region->len - done);
+                region->stream->read(slice->buf.data(), n);
+                uint64_t actual = region->stream->gcount();
+
+                slice->offset = region->offset + done;
+                slice->len = n;
+                slice->filled = actual;
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    read_time += seconds_since(start);
+                    if (actual != 0)
+                        filled_slices.push_back(std::move(slice));
+                    else
+                        free_slices.push_back(std::move(slice));
+                }
+                cond.notify_all();
+
+                done += actual;
+
+                // Nothing is left to read at the end of stream. The short slice
+                // is handled by UserMem::copy_from_stream in the writer.
+                if (actual < n)
+                    break;
+            }
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+            error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active_readers--;
+    }
+    cond.notify_all();
+}
+
+void RestoreEngine::run()
+{
+    if (regions.empty())
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Readers are mostly blocked on disk I/O, so use at least two of them
+    size_t nreaders = std::min<size_t>(regions.size(), std::max(2u, std::thread::hardware_concurrency()));
+
+    // Two slices per reader, so that a reader fills one while the other is being written
+    next_region = 0;
+    active_readers = nreaders;
+    read_time = 0;
+    error = nullptr;
+    free_slices.clear();
+    filled_slices.clear();
+    for (size_t i = 0; i < nreaders * 2; i++) {
+        auto slice = std::make_unique<Slice>();
+        slice->buf.resize(slice_size);
+        free_slices.push_back(std::move(slice));
+    }
+
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < nreaders; i++)
+        readers.emplace_back(&RestoreEngine::reader, this);
+
+    double write_time = 0, wait_time = 0;
+    uint64_t total = 0;
+
+    while (true) {
+        std::unique_ptr<Slice> slice;
+
+        {
+            auto wait_start = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this]() { return error || !filled_slices.empty() || active_readers == 0; });
+            wait_time += seconds_since(wait_start);
+            if (error || filled_slices.empty())
+                break;
+            slice = std::move(filled_slices.front());
+            filled_slices.pop_front();
+        }
+
+        auto write_start = std::chrono::steady_clock::now();
+
+        // Slices go through copy_from_stream, so that the transfer path of
+        // the backend (direct copy, DMA, ...) is used
+        try {
+            SliceIStream stream(slice->buf.data(), slice->filled);
+            total += mem.copy_from_stream(slice->offset, slice->len, stream);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+
+        write_time += seconds_since(write_start);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_slices.push_back(std::move(slice));
+        }
+        cond.notify_all();
+    }
+
+    cond.notify_all();
+    for (auto &t : readers)
+        t.join();
+
+    free_slices.clear();
+    filled_slices.clear();
+    regions.clear();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    double elapsed = seconds_since(start);
+    fprintf(stderr, "[REMU] INFO: restore memory: %lu regions, %lu readers, read %.6lfs, write %.6lfs, "
+        "write stall %.6lfs, elapsed time %.6lfs, rate %.2lf MB/s\n",
+        next_region, nreaders, read_time, write_time, wait_time, elapsed,
+        total / elapsed / 1e6);
+}
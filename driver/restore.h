@@ -0,0 +1,72 @@
+#ifndef _REMU_RESTORE_H_
+#define _REMU_RESTORE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <iostream>
+#include <condition_variable>
+
+#include "uma.h"
+
+namespace REMU {
+
+// Restore memory regions from checkpoint streams
+//
+// Regions are read (and decompressed) by multiple reader threads into a pool
+// of slice buffers, while slices already read are written to the device by
+// the calling thread with UserMem::copy_from_stream. UserMem implementations
+// are not thread-safe, so there is only one writer.
+
+class RestoreEngine
+{
+    struct Region
+    {
+        uint64_t offset;
+        uint64_t len;
+        std::unique_ptr<std::istream> stream;
+    };
+
+    struct Slice
+    {
+        std::vector<char> buf;
+        uint64_t offset;
+        uint64_t len;
+        uint64_t filled;    // less than len at the end of stream
+    };
+
+    UserMem &mem;
+    size_t slice_size;
+
+    std::vector<Region> regions;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t next_region;
+    size_t active_readers;
+    std::vector<std::unique_ptr<Slice>> free_slices;
+    std::deque<std::unique_ptr<Slice>> filled_slices;
+    std::exception_ptr error;
+
+    // accumulated busy time of readers in seconds
+    double read_time;
+
+    void reader();
+
+public:
+
+    void add(uint64_t offset, uint64_t len, std::unique_ptr<std::istream> stream);
+
+    // Restore all regions and wait for completion
+    void run();
+
+    RestoreEngine(UserMem &mem, size_t slice_size = 16UL*1024*1024) :
+        mem(mem), slice_size(slice_size) {}
+};
+
+};
+
+#endif
@@ -28,8 +28,6 @@ struct RTSignal
 
     // serializable data end
 
-    std::queue<std::pair<uint64_t, BitVector>> trace_replay_q;
-
     RTSignal(const SysInfo::SignalInfo &info) :
         name(flatten_name(info.name)),
         width(info.width),
@@ -38,6 +36,23 @@ struct RTSignal
     {}
 };
 
+// Input signal changes to be replayed, merged from all signals & sorted by tick
+struct ReplaySchedule
+{
+    struct Event
+    {
+        uint64_t tick;
+        const RTSignal *signal;
+        BitVector value;
+    };
+
+    std::vector<Event> events;
+    size_t next = 0;
+
+    bool empty() const { return next >= events.size(); }
+    uint64_t next_tick() const { return events[next].tick; }
+};
+
 struct RTTrigger
 {
     std::string name;
@@ -34,8 +34,10 @@ void UartModel::exit_term()
     term_mode = false;
 }
 
-void UartModel::poll(Driver &driver)
+bool UartModel::poll(Driver &driver)
 {
+    bool active = false;
+
     if (!driver.is_replay_mode()) {
         char ch = ch_to_send;
         ch_to_send = 0;
@@ -48,13 +50,17 @@ void UartModel::poll(Driver &driver)
             bool toggle = driver.get_signal_value(sig_rx_toggle).getBit(0);
             driver.set_signal_value(sig_rx_toggle, BitVector(1, !toggle));
             driver.set_signal_value(sig_rx_ch, BitVector(8, ch));
+            active = true;
         }
     }
 
     char ch;
     while (driver.read_uart_data(ch)) {
         write(1, &ch, 1);
+        active = true;
     }
+
+    return active;
 }
 
 bool UartModel::send(char ch)
@@ -24,7 +24,8 @@ public:
     void enter_term();
     void exit_term();
 
-    void poll(Driver &);
+    // -> whether any character is transferred
+    bool poll(Driver &);
 
     bool send(char ch);
 
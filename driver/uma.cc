@@ -7,7 +7,7 @@ inline constexpr uint64_t bufsize = 128UL*1024*1024; // 128MB
 uint64_t UserMem::copy_from_stream(uint64_t offset, uint64_t len, std::istream &stream)
 {
     uint64_t transferred = 0;
-    auto buf = new char[bufsize];
+    auto buf = new char[len < bufsize ? len : bufsize];
 
     while (len != 0 && !stream.eof()) {
         size_t n = len < bufsize ? len : bufsize;
@@ -26,7 +26,7 @@ uint64_t UserMem::copy_from_stream(uint64_t offset, uint64_t len, std::istream &
 uint64_t UserMem::copy_to_stream(uint64_t offset, uint64_t len, std::ostream &stream)
 {
     uint64_t transferred = 0;
-    auto buf = new char[bufsize];
+    auto buf = new char[len < bufsize ? len : bufsize];
 
     while (len != 0) {
         size_t n = len < bufsize ? len : bufsize;
@@ -40,3 +40,15 @@ uint64_t UserMem::copy_to_stream(uint64_t offset, uint64_t len, std::ostream &st
     delete[] buf;
     return transferred;
 }
+
+void UserIO::read_batch(const uint64_t *offsets, uint32_t *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        values[i] = read(offsets[i]);
+}
+
+void UserIO::write_batch(const uint64_t *offsets, const uint32_t *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        write(offsets[i], values[i]);
+}
@@ -28,6 +28,10 @@ public:
     virtual uint32_t read(uint64_t offset) = 0;
     virtual void write(uint64_t offset, uint32_t value) = 0;
     virtual ~UserIO() {}
+
+    // Gather reads / scatter writes of count registers, in order
+    virtual void read_batch(const uint64_t *offsets, uint32_t *values, size_t count);
+    virtual void write_batch(const uint64_t *offsets, const uint32_t *values, size_t count);
 };
 
 };
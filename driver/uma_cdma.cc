@@ -24,11 +24,25 @@ constexpr uint32_t XAXICDMA_SR_IDLE     = 1U << 1;
 constexpr uint32_t XAXICDMA_SR_ANYERR   =
     XAXICDMA_SR_DECERR | XAXICDMA_SR_SLVERR | XAXICDMA_SR_INTERR;
 
-void CDMAUserMem::cdma_xfer(uint64_t from, uint64_t to, uint32_t len)
+uint32_t CDMAUserMem::calc_max_xfer_size(uint64_t bounce_size)
+{
+    // Keep each half aligned to 64 bytes
+    uint64_t half = (bounce_size / 2) & ~uint64_t(0x3f);
+
+    if (half == 0)
+        throw std::invalid_argument("cdma bounce memory too small");
+
+    return half > CDMA_MAX_XFER_SIZE ? CDMA_MAX_XFER_SIZE : half;
+}
+
+void CDMAUserMem::cdma_start(uint64_t from, uint64_t to, uint32_t len)
 {
     if (len > max_xfer_size)
         throw std::invalid_argument("cdma xfer length too big");
 
+    // only one transfer can be in flight in simple mode
+    cdma_wait();
+
     // disable SG & interrupts
     cdma_reg.write(XAXICDMA_CDMACR, 0);
 
@@ -47,21 +61,49 @@ void CDMAUserMem::cdma_xfer(uint64_t from, uint64_t to, uint32_t len)
 
     cdma_reg.write(XAXICDMA_BTT, len);
 
+    cdma_busy = true;
+}
+
+void CDMAUserMem::cdma_wait()
+{
+    if (!cdma_busy)
+        return;
+
     while (!(cdma_reg.read(XAXICDMA_CDMASR) & XAXICDMA_SR_IDLE));
+
+    cdma_busy = false;
 }
 
+// For device-to-host transfers, CDMA fills one bounce half with slice i+1
+// while the CPU copies slice i out of the other half. For host-to-device
+// transfers, the CPU fills one half with slice i+1 while CDMA transfers
+// slice i from the other half.
+
 void CDMAUserMem::read(char *buf, uint64_t offset, uint64_t len)
 {
     if (offset + len > mem_size)
         throw std::invalid_argument("cdma xfer out of range");
 
-    while (len > 0) {
-        uint32_t slice = len > max_xfer_size ? max_xfer_size : len;
-        cdma_xfer(mem_base + offset, bounce_mem.dmabase(), slice);
-        bounce_mem.read(buf, 0, slice);
+    if (len == 0)
+        return;
+
+    uint32_t slice = len > max_xfer_size ? max_xfer_size : len;
+    cdma_start(mem_base + offset, bounce_mem.dmabase(), slice);
+
+    for (uint64_t i = 0; len > 0; i++) {
+        cdma_wait();
+
+        uint64_t next_offset = offset + slice;
+        uint64_t next_len = len - slice;
+        uint32_t next_slice = next_len > max_xfer_size ? max_xfer_size : next_len;
+        if (next_slice > 0)
+            cdma_start(mem_base + next_offset, bounce_mem.dmabase() + bounce_offset(i + 1), next_slice);
+
+        bounce_mem.read(buf, bounce_offset(i), slice);
         buf += slice;
-        offset += slice;
-        len -= slice;
+        offset = next_offset;
+        len = next_len;
+        slice = next_slice;
     }
 }
 
@@ -70,14 +112,17 @@ void CDMAUserMem::write(const char *buf, uint64_t offset, uint64_t len)
     if (offset + len > mem_size)
         throw std::invalid_argument("cdma xfer out of range");
 
-    while (len > 0) {
+    for (uint64_t i = 0; len > 0; i++) {
         uint32_t slice = len > max_xfer_size ? max_xfer_size : len;
-        bounce_mem.write(buf, 0, slice);
-        cdma_xfer(bounce_mem.dmabase(), mem_base + offset, slice);
+        // the previous transfer from this half has completed before the last cdma_start
+        bounce_mem.write(buf, bounce_offset(i), slice);
+        cdma_start(bounce_mem.dmabase() + bounce_offset(i), mem_base + offset, slice);
         buf += slice;
         offset += slice;
         len -= slice;
     }
+
+    cdma_wait();
 }
 
 void CDMAUserMem::fill(char c, uint64_t offset, uint64_t len)
@@ -85,14 +130,17 @@ void CDMAUserMem::fill(char c, uint64_t offset, uint64_t len)
     if (offset + len > mem_size)
         throw std::invalid_argument("cdma xfer out of range");
 
+    cdma_wait();
     bounce_mem.fill(c, 0, max_xfer_size);
 
     while (len > 0) {
         uint32_t slice = len > max_xfer_size ? max_xfer_size : len;
-        cdma_xfer(bounce_mem.dmabase(), mem_base + offset, slice);
+        cdma_start(bounce_mem.dmabase(), mem_base + offset, slice);
         offset += slice;
         len -= slice;
     }
+
+    cdma_wait();
 }
 
 uint64_t CDMAUserMem::copy_from_stream(uint64_t offset, uint64_t len, std::istream &stream)
@@ -102,10 +150,11 @@ uint64_t CDMAUserMem::copy_from_stream(uint64_t offset, uint64_t len, std::istre
 
     uint64_t transferred = 0;
 
-    while (len > 0) {
+    for (uint64_t i = 0; len > 0; i++) {
         uint32_t slice = len > max_xfer_size ? max_xfer_size : len;
-        uint32_t actual = bounce_mem.copy_from_stream(0, slice, stream);
-        cdma_xfer(bounce_mem.dmabase(), mem_base + offset, actual);
+        uint32_t actual = bounce_mem.copy_from_stream(bounce_offset(i), slice, stream);
+        if (actual > 0)
+            cdma_start(bounce_mem.dmabase() + bounce_offset(i), mem_base + offset, actual);
 
         offset += actual;
         len -= actual;
@@ -116,6 +165,8 @@ uint64_t CDMAUserMem::copy_from_stream(uint64_t offset, uint64_t len, std::istre
         }
     }
 
+    cdma_wait();
+
     return transferred;
 }
 
@@ -126,19 +177,35 @@ uint64_t CDMAUserMem::copy_to_stream(uint64_t offset, uint64_t len, std::ostream
 
     uint64_t transferred = 0;
 
-    while (len > 0) {
-        uint32_t slice = len > max_xfer_size ? max_xfer_size : len;
-        cdma_xfer(mem_base + offset, bounce_mem.dmabase(), slice);
-        uint32_t actual = bounce_mem.copy_to_stream(0, slice, stream);
+    if (len == 0)
+        return 0;
+
+    uint32_t slice = len > max_xfer_size ? max_xfer_size : len;
+    cdma_start(mem_base + offset, bounce_mem.dmabase(), slice);
+
+    for (uint64_t i = 0; len > 0; i++) {
+        cdma_wait();
+
+        uint64_t next_offset = offset + slice;
+        uint64_t next_len = len - slice;
+        uint32_t next_slice = next_len > max_xfer_size ? max_xfer_size : next_len;
+        if (next_slice > 0)
+            cdma_start(mem_base + next_offset, bounce_mem.dmabase() + bounce_offset(i + 1), next_slice);
+
+        uint32_t actual = bounce_mem.copy_to_stream(bounce_offset(i), slice, stream);
 
-        offset += actual;
-        len -= actual;
         transferred += actual;
 
         if (slice != actual) {
             break;
         }
+
+        offset = next_offset;
+        len = next_len;
+        slice = next_slice;
     }
 
+    cdma_wait();
+
     return transferred;
 }
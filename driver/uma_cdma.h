@@ -12,15 +12,25 @@ class CDMAUserMem : public UserMem
     uint64_t mem_base, mem_size;
 
     // Region of bounce memory with CDMA I/O coherency
+    // The bounce memory is split into two halves, so that the CPU copies one
+    // half while CDMA transfers the other.
     DMUserMemCached bounce_mem;
 
     // Region of CDMA MMIO registers
     DMUserIO cdma_reg;
 
     static constexpr uint32_t CDMA_MAX_XFER_SIZE = 0x02000000U;
-    uint32_t max_xfer_size; // min(CDMA_MAX_XFER_SIZE, bounce_size)
+    uint32_t max_xfer_size; // min(CDMA_MAX_XFER_SIZE, bounce_size / 2)
 
-    void cdma_xfer(uint64_t from, uint64_t to, uint32_t len);
+    bool cdma_busy;
+
+    // Offset of the bounce half used by the i-th slice
+    uint64_t bounce_offset(uint64_t i) const { return (i & 1) ? max_xfer_size : 0; }
+
+    void cdma_start(uint64_t from, uint64_t to, uint32_t len);
+    void cdma_wait();
+
+    static uint32_t calc_max_xfer_size(uint64_t bounce_size);
 
 public:
 
@@ -52,7 +62,8 @@ public:
         mem_size(mem_size),
         bounce_mem(bounce_base, bounce_size, bounce_base),
         cdma_reg(cdma_base, 0x1000),
-        max_xfer_size(bounce_size > CDMA_MAX_XFER_SIZE ? CDMA_MAX_XFER_SIZE : bounce_size)
+        max_xfer_size(calc_max_xfer_size(bounce_size)),
+        cdma_busy(false)
     {}
 };
 
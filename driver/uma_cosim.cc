@@ -6,16 +6,31 @@
 #include <cstring>
 
 #include <memory>
+#include <stdexcept>
 
 using namespace REMU;
 
+// Register writes are posted, so memory accesses wait for them to complete
+// in case they start a transfer on the emulator side.
+
 static std::unique_ptr<CosimClient> client;
+static std::string client_shm_name;
 static unsigned int client_refcount = 0;
 
-inline void start_client()
+// Memory and registers share one client, so all users must be in the same session
+inline void start_client(const std::string &session)
 {
-    if (client_refcount == 0)
-        client = std::make_unique<CosimClient>();
+    auto shm_name = cosim_shm_name(session);
+
+    if (client_refcount == 0) {
+        client = std::make_unique<CosimClient>(session);
+        client_shm_name = shm_name;
+    }
+    else if (shm_name != client_shm_name) {
+        throw std::invalid_argument("cosim shared memory " + shm_name + " requested while attached to " +
+            client_shm_name);
+    }
+
     client_refcount++;
 }
 
@@ -27,9 +42,9 @@ inline void stop_client()
         client = 0;
 }
 
-CosimUserMem::CosimUserMem()
+CosimUserMem::CosimUserMem(const std::string &session)
 {
-    start_client();
+    start_client(session);
 }
 
 CosimUserMem::~CosimUserMem()
@@ -37,9 +52,9 @@ CosimUserMem::~CosimUserMem()
     stop_client();
 }
 
-CosimUserIO::CosimUserIO()
+CosimUserIO::CosimUserIO(const std::string &session)
 {
-    start_client();
+    start_client(session);
 }
 
 CosimUserIO::~CosimUserIO()
@@ -49,16 +64,19 @@ CosimUserIO::~CosimUserIO()
 
 void CosimUserMem::read(char *buf, uint64_t offset, uint64_t len)
 {
+    client->sync();
     memcpy(buf, (char*)client->mem_ptr() + offset, len);
 }
 
 void CosimUserMem::write(const char *buf, uint64_t offset, uint64_t len)
 {
+    client->sync();
     memcpy((char*)client->mem_ptr() + offset, buf, len);
 }
 
 void CosimUserMem::fill(char c, uint64_t offset, uint64_t len)
 {
+    client->sync();
     memset((char*)client->mem_ptr() + offset, c, len);
 }
 
@@ -67,6 +85,26 @@ uint64_t CosimUserMem::size() const
     return client->mem_size();
 }
 
+uint64_t CosimUserMem::copy_from_stream(uint64_t offset, uint64_t len, std::istream &stream)
+{
+    if (offset + len > client->mem_size())
+        throw std::invalid_argument("memory access out of range");
+
+    client->sync();
+    stream.read((char*)client->mem_ptr() + offset, len);
+    return stream.gcount();
+}
+
+uint64_t CosimUserMem::copy_to_stream(uint64_t offset, uint64_t len, std::ostream &stream)
+{
+    if (offset + len > client->mem_size())
+        throw std::invalid_argument("memory access out of range");
+
+    client->sync();
+    stream.write((char*)client->mem_ptr() + offset, len);
+    return len;
+}
+
 uint32_t CosimUserIO::read(uint64_t offset)
 {
     return client->reg_read(offset);
@@ -77,4 +115,14 @@ void CosimUserIO::write(uint64_t offset, uint32_t value)
     client->reg_write(offset, value);
 }
 
+void CosimUserIO::read_batch(const uint64_t *offsets, uint32_t *values, size_t count)
+{
+    client->reg_read_batch(offsets, values, count);
+}
+
+void CosimUserIO::write_batch(const uint64_t *offsets, const uint32_t *values, size_t count)
+{
+    client->reg_write_batch(offsets, values, count);
+}
+
 #endif
@@ -1,6 +1,8 @@
 #ifndef _DRIVER_COSIM_H_
 #define _DRIVER_COSIM_H_
 
+#include <string>
+
 #include "uma.h"
 
 namespace REMU {
@@ -19,7 +21,11 @@ public:
     virtual uint64_t size() const override;
     virtual uint64_t dmabase() const override { return 0; }
 
-    CosimUserMem();
+    // Transfer between the stream and the shared memory directly
+    virtual uint64_t copy_from_stream(uint64_t offset, uint64_t len, std::istream &stream) override;
+    virtual uint64_t copy_to_stream(uint64_t offset, uint64_t len, std::ostream &stream) override;
+
+    CosimUserMem(const std::string &session = "");
     virtual ~CosimUserMem();
 };
 
@@ -30,8 +36,10 @@ public:
 
     virtual uint32_t read(uint64_t offset) override;
     virtual void write(uint64_t offset, uint32_t value) override;
+    virtual void read_batch(const uint64_t *offsets, uint32_t *values, size_t count) override;
+    virtual void write_batch(const uint64_t *offsets, const uint32_t *values, size_t count) override;
 
-    CosimUserIO();
+    CosimUserIO(const std::string &session = "");
     virtual ~CosimUserIO();
 };
 
@@ -11,6 +11,10 @@
 #include <stdexcept>
 #include <system_error>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace REMU;
 
 DevMem::DevMem(size_t base, size_t size, bool sync, std::string dev)
@@ -68,7 +72,139 @@ void DevMem::write_u32(size_t offset, uint32_t value)
     ((volatile uint32_t *)m_ptr)[offset >> 2] = value;
 }
 
+void DevMem::read_u32_batch(const uint64_t *offsets, uint32_t *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if ((offsets[i] & 0x3) != 0)
+            throw std::invalid_argument("offset must be a multiple of 4");
+
+    auto p = (volatile uint32_t *)m_ptr;
+    for (size_t i = 0; i < count; i++)
+        values[i] = p[offsets[i] >> 2];
+}
+
+void DevMem::write_u32_batch(const uint64_t *offsets, const uint32_t *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if ((offsets[i] & 0x3) != 0)
+            throw std::invalid_argument("offset must be a multiple of 4");
+
+    auto p = (volatile uint32_t *)m_ptr;
+    for (size_t i = 0; i < count; i++)
+        p[offsets[i] >> 2] = values[i];
+}
+
 void DevMem::fill(char c, size_t offset, size_t len)
 {
     memset((char *)m_ptr + offset, c, len);
 }
+
+#ifdef __SSE2__
+
+// The unaligned head and tail are left to memcpy/memset, and the aligned body
+// is written with 16-byte streaming stores. The final sfence makes the stores
+// globally visible before e.g. the BAR window is switched.
+
+void DevMem::write_nt(const char *buf, size_t offset, size_t len)
+{
+    char *dst = (char *)m_ptr + offset;
+
+    size_t head = (-(uintptr_t)dst) & 0xf;
+    if (head > len)
+        head = len;
+
+    memcpy(dst, buf, head);
+    dst += head;
+    buf += head;
+    len -= head;
+
+    auto d = (__m128i *)dst;
+    auto s = (const __m128i *)buf;
+
+    while (len >= 64) {
+        __m128i x0 = _mm_loadu_si128(s);
+        __m128i x1 = _mm_loadu_si128(s + 1);
+        __m128i x2 = _mm_loadu_si128(s + 2);
+        __m128i x3 = _mm_loadu_si128(s + 3);
+        _mm_stream_si128(d, x0);
+        _mm_stream_si128(d + 1, x1);
+        _mm_stream_si128(d + 2, x2);
+        _mm_stream_si128(d + 3, x3);
+        d += 4;
+        s += 4;
+        len -= 64;
+    }
+
+    while (len >= 16) {
+        _mm_stream_si128(d++, _mm_loadu_si128(s++));
+        len -= 16;
+    }
+
+    memcpy(d, s, len);
+    _mm_sfence();
+}
+
+void DevMem::fill_nt(char c, size_t offset, size_t len)
+{
+    char *dst = (char *)m_ptr + offset;
+
+    size_t head = (-(uintptr_t)dst) & 0xf;
+    if (head > len)
+        head = len;
+
+    memset(dst, c, head);
+    dst += head;
+    len -= head;
+
+    auto d = (__m128i *)dst;
+    __m128i x = _mm_set1_epi8(c);
+
+    while (len >= 64) {
+        _mm_stream_si128(d, x);
+        _mm_stream_si128(d + 1, x);
+        _mm_stream_si128(d + 2, x);
+        _mm_stream_si128(d + 3, x);
+        d += 4;
+        len -= 64;
+    }
+
+    while (len >= 16) {
+        _mm_stream_si128(d++, x);
+        len -= 16;
+    }
+
+    memset(d, c, len);
+    _mm_sfence();
+}
+
+#else
+
+void DevMem::write_nt(const char *buf, size_t offset, size_t len)
+{
+    write(buf, offset, len);
+}
+
+void DevMem::fill_nt(char c, size_t offset, size_t len)
+{
+    fill(c, offset, len);
+}
+
+#endif
+
+uint64_t DMUserMemBase::copy_from_stream(uint64_t offset, uint64_t len, std::istream &stream)
+{
+    if (offset + len > dm.size())
+        throw std::invalid_argument("memory access out of range");
+
+    stream.read(dm.ptr() + offset, len);
+    return stream.gcount();
+}
+
+uint64_t DMUserMemBase::copy_to_stream(uint64_t offset, uint64_t len, std::ostream &stream)
+{
+    if (offset + len > dm.size())
+        throw std::invalid_argument("memory access out of range");
+
+    stream.write(dm.ptr() + offset, len);
+    return len;
+}
@@ -15,14 +15,22 @@ public:
 
     size_t base() const { return m_base; }
     size_t size() const { return m_size; }
+    char *ptr() const { return static_cast<char *>(m_ptr); }
 
     void read(char *buf, size_t offset, size_t len);
     void write(const char *buf, size_t offset, size_t len);
     uint32_t read_u32(size_t offset);
     void write_u32(size_t offset, uint32_t value);
+    void read_u32_batch(const uint64_t *offsets, uint32_t *values, size_t count);
+    void write_u32_batch(const uint64_t *offsets, const uint32_t *values, size_t count);
 
     void fill(char c, size_t offset, size_t len);
 
+    // Non-temporal (streaming) stores for large blocks, which are combined
+    // into full bursts on write-combining mappings
+    void write_nt(const char *buf, size_t offset, size_t len);
+    void fill_nt(char c, size_t offset, size_t len);
+
     DevMem(size_t base, size_t size, bool sync, std::string dev = "/dev/mem");
     ~DevMem();
 };
@@ -49,9 +57,23 @@ public:
         dm.fill(c, offset, len);
     }
 
+    void write_nt(const char *buf, uint64_t offset, uint64_t len)
+    {
+        dm.write_nt(buf, offset, len);
+    }
+
+    void fill_nt(char c, uint64_t offset, uint64_t len)
+    {
+        dm.fill_nt(c, offset, len);
+    }
+
     virtual uint64_t size() const override { return dm.size(); }
     virtual uint64_t dmabase() const override { return m_dmabase; }
 
+    // Transfer between the stream and the mapped region directly
+    virtual uint64_t copy_from_stream(uint64_t offset, uint64_t len, std::istream &stream) override;
+    virtual uint64_t copy_to_stream(uint64_t offset, uint64_t len, std::ostream &stream) override;
+
     DMUserMemBase(uint64_t base, uint64_t size, uint64_t dmabase, bool sync, std::string dev = "/dev/mem")
         : dm(base, size, sync, dev), m_dmabase(dmabase) {}
 };
@@ -86,6 +108,16 @@ public:
         dm.write_u32(offset, value);
     }
 
+    virtual void read_batch(const uint64_t *offsets, uint32_t *values, size_t count) override
+    {
+        dm.read_u32_batch(offsets, values, count);
+    }
+
+    virtual void write_batch(const uint64_t *offsets, const uint32_t *values, size_t count) override
+    {
+        dm.write_u32_batch(offsets, values, count);
+    }
+
     DMUserIO(uint64_t base, uint64_t size, std::string dev = "/dev/mem") : dm(base, size, true, dev) {}
 };
 
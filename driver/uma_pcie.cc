@@ -1,10 +1,10 @@
 #include "uma_pcie.h"
 #include "emu_utils.h"
 
-#include <cstdio>
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <system_error>
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -13,12 +13,101 @@
 
 using namespace REMU;
 
+void PCIeDMAUserMem::worker(Queue &queue, int fd, bool to_dev)
+{
+    while (true) {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_cond.wait(lock, [this, &queue]() { return stop || !queue.jobs.empty(); });
+            if (queue.jobs.empty())
+                return;
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+
+        std::exception_ptr error;
+
+        try {
+            // XDMA may complete a request partially
+            while (job.len > 0) {
+                ssize_t n = to_dev ?
+                    ::pwrite(fd, job.buf, job.len, job.addr) :
+                    ::pread(fd, job.buf, job.len, job.addr);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0)
+                    throw std::system_error(errno, std::generic_category(), "dma transfer failed");
+                if (n == 0)
+                    throw std::runtime_error("dma transfer stopped unexpectedly");
+                job.buf += n;
+                job.addr += n;
+                job.len -= n;
+            }
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (error && !job.batch->error)
+                job.batch->error = error;
+            job.batch->pending--;
+        }
+        done_cond.notify_all();
+    }
+}
+
+void PCIeDMAUserMem::submit(Queue &queue, Batch &batch, char *buf, uint64_t offset, uint64_t len)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (len > 0) {
+            uint64_t slice = std::min(len, XFER_CHUNK_SIZE);
+            queue.jobs.push_back({buf, mem_base + offset, slice, &batch});
+            batch.pending++;
+            buf += slice;
+            offset += slice;
+            len -= slice;
+        }
+    }
+    job_cond.notify_all();
+}
+
+void PCIeDMAUserMem::drain(Batch &batch)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cond.wait(lock, [&batch]() { return batch.pending == 0; });
+}
+
+void PCIeDMAUserMem::wait(Batch &batch)
+{
+    drain(batch);
+
+    if (batch.error) {
+        auto error = batch.error;
+        batch.error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void PCIeDMAUserMem::alloc_staging()
+{
+    for (auto &buf : staging)
+        if (!buf)
+            buf = std::make_unique<HostBuffer>(STAGING_SIZE);
+}
+
 void PCIeDMAUserMem::read(char *buf, uint64_t offset, uint64_t len)
 {
     if (offset + len > mem_size)
         throw std::invalid_argument("memory access out of range");
 
-    ::pread(c2h_fd, buf, len, mem_base + offset);
+    Batch batch;
+    submit(c2h_queue, batch, buf, offset, len);
+    wait(batch);
 }
 
 void PCIeDMAUserMem::write(const char *buf, uint64_t offset, uint64_t len)
@@ -26,7 +115,10 @@ void PCIeDMAUserMem::write(const char *buf, uint64_t offset, uint64_t len)
     if (offset + len > mem_size)
         throw std::invalid_argument("memory access out of range");
 
-    ::pwrite(h2c_fd, buf, len, mem_base + offset);
+    // the buffer is only read by h2c workers
+    Batch batch;
+    submit(h2c_queue, batch, const_cast<char *>(buf), offset, len);
+    wait(batch);
 }
 
 void PCIeDMAUserMem::fill(char c, uint64_t offset, uint64_t len)
@@ -34,31 +126,162 @@ void PCIeDMAUserMem::fill(char c, uint64_t offset, uint64_t len)
     if (offset + len > mem_size)
         throw std::invalid_argument("memory access out of range");
 
-    uint64_t bufsz = std::min(len, 0x100000UL);
-    auto buf = new char[bufsz];
-    std::fill_n(buf, bufsz, 0);
+    alloc_staging();
 
-    ::lseek(h2c_fd, mem_base + offset, SEEK_SET);
+    char *buf = staging[0]->data();
+    uint64_t bufsz = std::min(len, STAGING_SIZE);
+    std::fill_n(buf, bufsz, c);
 
+    // All chunks are sourced from the same buffer
+    Batch batch;
     while (len > 0) {
         uint64_t slice = std::min(bufsz, len);
-        ::write(h2c_fd, buf, slice);
+        submit(h2c_queue, batch, buf, offset, slice);
+        offset += slice;
         len -= slice;
     }
+    wait(batch);
+}
+
+uint64_t PCIeDMAUserMem::copy_from_stream(uint64_t offset, uint64_t len, std::istream &stream)
+{
+    if (offset + len > mem_size)
+        throw std::invalid_argument("memory access out of range");
+
+    alloc_staging();
+
+    // Read the next slice from the stream while the previous one is being written
+    Batch batch[2];
+    uint64_t transferred = 0;
+
+    try {
+        for (int i = 0; len != 0 && !stream.eof(); i ^= 1) {
+            wait(batch[i]);
+            uint64_t n = std::min(len, STAGING_SIZE);
+            stream.read(staging[i]->data(), n);
+            n = stream.gcount();
+            if (n == 0)
+                break;
+            submit(h2c_queue, batch[i], staging[i]->data(), offset, n);
+            offset += n;
+            transferred += n;
+            len -= n;
+        }
+
+        wait(batch[0]);
+        wait(batch[1]);
+    }
+    catch (...) {
+        drain(batch[0]);
+        drain(batch[1]);
+        throw;
+    }
+
+    return transferred;
+}
+
+uint64_t PCIeDMAUserMem::copy_to_stream(uint64_t offset, uint64_t len, std::ostream &stream)
+{
+    if (offset + len > mem_size)
+        throw std::invalid_argument("memory access out of range");
+
+    alloc_staging();
+
+    // Read the next slice from the device while the previous one is being written to the stream
+    Batch batch[2];
+    uint64_t transferred = 0;
+
+    try {
+        uint64_t n = std::min(len, STAGING_SIZE);
+        submit(c2h_queue, batch[0], staging[0]->data(), offset, n);
+
+        for (int i = 0; len != 0; i ^= 1) {
+            wait(batch[i]);
+
+            uint64_t next = std::min(len - n, STAGING_SIZE);
+            if (next != 0)
+                submit(c2h_queue, batch[i ^ 1], staging[i ^ 1]->data(), offset + n, next);
+
+            stream.write(staging[i]->data(), n);
+            offset += n;
+            transferred += n;
+            len -= n;
+            n = next;
+        }
+    }
+    catch (...) {
+        drain(batch[0]);
+        drain(batch[1]);
+        throw;
+    }
+
+    return transferred;
+}
+
+PCIeDMAUserMem::PCIeDMAUserMem(uint64_t mem_base, uint64_t mem_size,
+    const std::vector<std::string> &c2h, const std::vector<std::string> &h2c)
+    : mem_base(mem_base), mem_size(mem_size), stop(false)
+{
+    if (c2h.empty() || h2c.empty())
+        throw std::invalid_argument("at least one c2h and one h2c channel are required");
+
+    auto close_all = [this]() {
+        for (int fd : c2h_queue.fds)
+            ::close(fd);
+        for (int fd : h2c_queue.fds)
+            ::close(fd);
+    };
+
+    for (auto &dev : c2h) {
+        int fd = ::open(dev.c_str(), O_RDONLY);
+        if (fd < 0) {
+            int err = errno;
+            close_all();
+            throw std::system_error(err, std::generic_category(), "failed to open " + dev);
+        }
+        c2h_queue.fds.push_back(fd);
+    }
+
+    for (auto &dev : h2c) {
+        int fd = ::open(dev.c_str(), O_WRONLY);
+        if (fd < 0) {
+            int err = errno;
+            close_all();
+            throw std::system_error(err, std::generic_category(), "failed to open " + dev);
+        }
+        h2c_queue.fds.push_back(fd);
+    }
+
+    for (int fd : c2h_queue.fds)
+        workers.emplace_back(&PCIeDMAUserMem::worker, this, std::ref(c2h_queue), fd, false);
+    for (int fd : h2c_queue.fds)
+        workers.emplace_back(&PCIeDMAUserMem::worker, this, std::ref(h2c_queue), fd, true);
+}
+
+PCIeDMAUserMem::~PCIeDMAUserMem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    job_cond.notify_all();
+
+    for (auto &t : workers)
+        t.join();
 
-    delete[] buf;
+    for (int fd : c2h_queue.fds)
+        ::close(fd);
+    for (int fd : h2c_queue.fds)
+        ::close(fd);
 }
 
-PCIeDMAUserMem::PCIeDMAUserMem(uint64_t mem_base, uint64_t mem_size, std::string c2h, std::string h2c)
-    : mem_base(mem_base), mem_size(mem_size)
+void PCIeBARUserMem::select_segment(uint64_t seg)
 {
-    c2h_fd = ::open(c2h.c_str(), O_RDONLY);
-    if (c2h_fd < 0)
-        throw std::system_error(errno, std::generic_category(), "failed to open " + c2h);
+    if (seg == cur_seg)
+        return;
 
-    h2c_fd = ::open(h2c.c_str(), O_WRONLY);
-    if (h2c_fd < 0)
-        throw std::system_error(errno, std::generic_category(), "failed to open " + h2c);
+    ctrl_bar.write(ctrl_reg_offset, seg);
+    cur_seg = seg;
 }
 
 void PCIeBARUserMem::read(char *buf, uint64_t offset, uint64_t len)
@@ -73,7 +296,7 @@ void PCIeBARUserMem::read(char *buf, uint64_t offset, uint64_t len)
 
     while (len > 0) {
         uint64_t slice = std::min(len, bar_size - offset);
-        ctrl_bar.write(ctrl_reg_offset, seg);
+        select_segment(seg);
         mem_bar.read(buf, offset, slice);
         buf += slice;
         len -= slice;
@@ -94,8 +317,11 @@ void PCIeBARUserMem::write(const char *buf, uint64_t offset, uint64_t len)
 
     while (len > 0) {
         uint64_t slice = std::min(len, bar_size - offset);
-        ctrl_bar.write(ctrl_reg_offset, seg);
-        mem_bar.write(buf, offset, slice);
+        select_segment(seg);
+        if (slice >= NT_THRESHOLD)
+            mem_bar.write_nt(buf, offset, slice);
+        else
+            mem_bar.write(buf, offset, slice);
         buf += slice;
         len -= slice;
         seg++;
@@ -115,8 +341,11 @@ void PCIeBARUserMem::fill(char c, uint64_t offset, uint64_t len)
 
     while (len > 0) {
         uint64_t slice = std::min(len, bar_size - offset);
-        ctrl_bar.write(ctrl_reg_offset, seg);
-        mem_bar.fill(c, offset, slice);
+        select_segment(seg);
+        if (slice >= NT_THRESHOLD)
+            mem_bar.fill_nt(c, offset, slice);
+        else
+            mem_bar.fill(c, offset, slice);
         len -= slice;
         seg++;
         offset = 0;
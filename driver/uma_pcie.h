@@ -1,17 +1,73 @@
 #ifndef _DRIVER_UMA_PCIE_BAR_H_
 #define _DRIVER_UMA_PCIE_BAR_H_
 
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
 #include "uma.h"
 #include "uma_devmem.h"
+#include "host_buffer.h"
 
 namespace REMU {
 
+// Memory accessed through XDMA character devices
+//
+// Transfers are split into chunks which are spread across all c2h/h2c
+// channels. Each channel is served by its own thread, so that there is one
+// request in flight per channel.
+
 class PCIeDMAUserMem : public UserMem
 {
     // Region of device memory
     uint64_t mem_base, mem_size;
 
-    int c2h_fd, h2c_fd;
+    static constexpr uint64_t XFER_CHUNK_SIZE = 0x400000UL;  // 4MB
+    static constexpr uint64_t STAGING_SIZE = 0x2000000UL;    // 32MB
+
+    struct Batch
+    {
+        size_t pending = 0;
+        std::exception_ptr error;
+    };
+
+    struct Job
+    {
+        char *buf;
+        uint64_t addr;
+        uint64_t len;
+        Batch *batch;
+    };
+
+    struct Queue
+    {
+        std::vector<int> fds;
+        std::deque<Job> jobs;
+    };
+
+    Queue c2h_queue, h2c_queue;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable job_cond, done_cond;
+    bool stop;
+
+    // Page-aligned buffers for stream copies, allocated on first use
+    std::unique_ptr<HostBuffer> staging[2];
+
+    void worker(Queue &queue, int fd, bool to_dev);
+
+    void submit(Queue &queue, Batch &batch, char *buf, uint64_t offset, uint64_t len);
+    void wait(Batch &batch);
+
+    // Wait for completion without raising errors
+    void drain(Batch &batch);
+
+    void alloc_staging();
 
 public:
 
@@ -29,7 +85,15 @@ public:
         return mem_base;
     }
 
-    PCIeDMAUserMem(uint64_t mem_base, uint64_t mem_size, std::string c2h, std::string h2c);
+    virtual uint64_t copy_from_stream(uint64_t offset, uint64_t len, std::istream &stream) override;
+    virtual uint64_t copy_to_stream(uint64_t offset, uint64_t len, std::ostream &stream) override;
+
+    PCIeDMAUserMem(uint64_t mem_base, uint64_t mem_size,
+        const std::vector<std::string> &c2h, const std::vector<std::string> &h2c);
+    ~PCIeDMAUserMem();
+
+    PCIeDMAUserMem(const PCIeDMAUserMem &) = delete;
+    PCIeDMAUserMem& operator=(const PCIeDMAUserMem &) = delete;
 };
 
 class PCIeBARUserMem : public UserMem
@@ -44,6 +108,14 @@ class PCIeBARUserMem : public UserMem
     DMUserIO ctrl_bar;
     uint64_t ctrl_reg_offset;
 
+    // Segment currently mapped to the memory BAR, or ~0 if unknown
+    uint64_t cur_seg;
+
+    // Blocks of at least this size are written with streaming stores
+    static constexpr uint64_t NT_THRESHOLD = 0x1000;
+
+    void select_segment(uint64_t seg);
+
 public:
 
     virtual void read(char *buf, uint64_t offset, uint64_t len) override;
@@ -72,7 +144,8 @@ public:
         mem_size(mem_size),
         mem_bar(0, mem_bar_size, 0, dev_mem_bar),
         ctrl_bar(ctrl_reg_address & ~0xffful, 1000, dev_ctrl_bar),
-        ctrl_reg_offset(ctrl_reg_address & 0xffful)
+        ctrl_reg_offset(ctrl_reg_address & 0xffful),
+        cur_seg(~0ul)
     {}
 };
 
@@ -52,6 +52,9 @@ void replay_startup_routine() {
         return;
     }
 
+    // Circuit state and RAM models hold many wide vectors
+    BitVectorUtils::set_pool_enabled(true);
+
     SysInfo sysinfo;
     std::ifstream f(sysinfo_file);
     if (f.fail()) {
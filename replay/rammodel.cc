@@ -8,25 +8,29 @@ static void load_fifo(std::queue<BitVector> &fifo, CircuitState &circuit, const
 {
     // assuming circuit is an instance of emulib_ready_valid_fifo
 
+    auto &names = circuit.names;
+    auto base = names.find(path);
+    auto fifo_base = names.find(base, "fifo");
+
     // process output reg in emulib_ready_valid_fifo
 
-    auto &ovalid = circuit.wire.at(path / "ovalid").data;
+    auto &ovalid = circuit.wire.at(names.find(base, "ovalid")).data;
     if (ovalid != 0) {
         // FAST_READ is 0 for all savable FIFOs in rammodel backend
-        fifo.push(circuit.wire.at(path / "fifo" / "rdata").data);
+        fifo.push(circuit.wire.at(names.find(fifo_base, "rdata")).data);
     }
 
     // process emulib_fifo instance
 
-    auto &rempty = circuit.wire.at(path / "fifo" / "rempty").data;
+    auto &rempty = circuit.wire.at(names.find(fifo_base, "rempty")).data;
     if (rempty != 0)
         return;
 
-    int rp = circuit.wire.at(path / "fifo" / "rp").data;
-    int wp = circuit.wire.at(path / "fifo" / "wp").data;
+    int rp = circuit.wire.at(names.find(fifo_base, "rp")).data;
+    int wp = circuit.wire.at(names.find(fifo_base, "wp")).data;
 
     // TODO: dissolved RAM
-    auto &data = circuit.ram.at(path / "fifo" / "data").data;
+    auto &data = circuit.ram.at(names.find(fifo_base, "data")).data;
 
     int depth = data.depth();
     int start_offset = data.start_offset();
@@ -94,7 +98,7 @@ bool RamModel::schedule()
 
             for (int j = 0; j < data_width / 8; j++)
                 if (w.strb.getBit(j))
-                    word.setValue(j * 8, w.data.getValue(j * 8, 8));
+                    word.setWord(j * 8, 8, w.data.getWord(j * 8, 8));
 
             data.setValue(address * 8, word);
             w_queue.pop();
@@ -11,19 +11,36 @@
 
 using namespace REMU;
 
-inline std::string get_full_name(const std::vector<std::string> &path)
+vpiHandle VPILoader::lookup_scope(NameTable::id_t id)
 {
-    std::string full_name;
-    bool first = true;
-    for (auto &name : path) {
-        std::string esc_name = Escape::escape_verilog_id(name);
-        if (first)
-            first = false;
-        else
-            full_name += ".";
-        full_name += esc_name;
+    auto it = scope_handles.find(id);
+    if (it != scope_handles.end())
+        return it->second;
+
+    vpiHandle obj = lookup(id);
+    scope_handles[id] = obj;
+    return obj;
+}
+
+vpiHandle VPILoader::lookup(NameTable::id_t id)
+{
+    auto &names = circuit.names;
+
+    // Look up the object by its own name in the parent scope, and fall back
+    // to the full name in case the simulator does not resolve it
+    auto parent = names.parent(id);
+    if (parent != NameTable::root) {
+        vpiHandle scope = lookup_scope(parent);
+        if (scope != 0) {
+            std::string name = Escape::escape_verilog_id(names.component(id));
+            vpiHandle obj = vpi_handle_by_name(name.c_str(), scope);
+            if (obj != 0)
+                return obj;
+        }
     }
-    return full_name;
+
+    std::string full_name = names.flat_name(id);
+    return vpi_handle_by_name(full_name.c_str(), 0);
 }
 
 void VPILoader::load()
@@ -31,12 +48,11 @@ void VPILoader::load()
     circuit.load(ckpt);
 
     for (auto &it : circuit.wire) {
-        std::string full_name = get_full_name(it.first);
-        vpiHandle obj = vpi_handle_by_name(full_name.c_str(), 0);
+        vpiHandle obj = lookup(it.first);
         if (obj == 0) {
             if (!suppress_warning)
                 vpi_printf("WARNING: %s cannot be referenced\n",
-                    full_name.c_str());
+                    circuit.names.flat_name(it.first).c_str());
             continue;
         }
         vpiSetValue(obj, it.second.data);
@@ -45,17 +61,31 @@ void VPILoader::load()
     for (auto &it : circuit.ram) {
         if (it.second.dissolved)
             continue;
-        std::string full_name = get_full_name(it.first);
-        vpiHandle obj = vpi_handle_by_name(full_name.c_str(), 0);
+        vpiHandle obj = lookup(it.first);
         if (obj == 0) {
             if (!suppress_warning)
                 vpi_printf("WARNING: %s cannot be referenced\n",
-                    full_name.c_str());
+                    circuit.names.flat_name(it.first).c_str());
             continue;
         }
-        int depth = it.second.data.depth();
-        int start_offset = it.second.data.start_offset();
+
+        auto &data = it.second.data;
+        int width = data.width();
+        int depth = data.depth();
+        int start_offset = data.start_offset();
+        auto words = data.flattened_view();
+
+        // Words equal to the initial data are already set by the design
+        auto &info = sysinfo.ram.at(circuit.names.path(it.first));
+        BitVector init;
+        if (!info.init_zero)
+            init = BitVector::from_literal(info.init_data);
+
         for (int i = 0; i < depth; i++) {
+            auto word = words.view(BitVector::width_t(i) * width, width);
+            if (!info.init_zero && word == init.view(BitVector::width_t(i) * width, width))
+                continue;
+
             int index = i + start_offset;
             vpiHandle word_obj = vpi_handle_by_index(obj, index);
             if (word_obj == 0) {
@@ -64,9 +94,16 @@ void VPILoader::load()
                         vpi_get_str(vpiFullName, obj), index);
                 continue;
             }
-            vpiSetValue(word_obj, it.second.data.get(i));
+            vpiSetValue(word_obj, word);
+            vpi_free_object(word_obj);
         }
     }
+
+    // Scope handles are no longer needed after loading
+    for (auto &it : scope_handles)
+        if (it.second != 0)
+            vpi_free_object(it.second);
+    scope_handles.clear();
 }
 
 std::vector<RamModel> rammodel_list;
@@ -98,12 +135,12 @@ int rammodel_new_tf(char* user_data)
     vpi_printf("rammodel info: %s registered with handle %ld\n", name.c_str(), index);
 
     auto data_stream = loader->ckpt.axi_mems.at(name + ".host_axi").read();
-    if (data_stream.fail()) {
+    if (data_stream->fail()) {
         vpi_printf("ERROR: failed to open rammodel data file\n");
         vpiSetValue(callh, -1);
         return 0;
     }
-    if (!rammodel_list[index].load_data(data_stream)) {
+    if (!rammodel_list[index].load_data(*data_stream)) {
         vpi_printf("ERROR: failed to load rammodel data from checkpoint\n");
         vpiSetValue(callh, -1);
         return 0;
@@ -7,6 +7,8 @@
 
 #include "vpi_user.h"
 
+#include <unordered_map>
+
 namespace REMU {
 
 struct VPILoader
@@ -26,6 +28,14 @@ struct VPILoader
     }
 
     void load();
+
+private:
+
+    // Handles of scopes containing loaded objects, which are looked up once
+    std::unordered_map<NameTable::id_t, vpiHandle> scope_handles;
+
+    vpiHandle lookup_scope(NameTable::id_t id);
+    vpiHandle lookup(NameTable::id_t id);
 };
 
 void register_tfs(REMU::VPILoader *loader);
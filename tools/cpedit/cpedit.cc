@@ -178,20 +178,21 @@ bool CpEdit::cmd_ff(const std::vector<std::string> &args)
         return false;
     }
 
-    auto &data = circuit.wire.at(ff_name_map.at(ff_name)).data;
+    auto id = ff_name_map.at(ff_name);
 
     if (args.size() == 2) {
-        printf("%s\n", data.bin().c_str());
+        printf("%s\n", circuit.get_wire(id).bin().c_str());
         return true;
     }
 
     std::string value = args[2];
-    if (value.size() != data.width()) {
-        fprintf(stderr, "Value width must be %lu\n", data.width());
+    size_t width = circuit.wire.at(id).info->width;
+    if (value.size() != width) {
+        fprintf(stderr, "Value width must be %lu\n", width);
         return false;
     }
 
-    data = BitVector(args[2]);
+    circuit.set_wire(id, BitVector(value));
     return true;
 }
 
@@ -215,29 +216,34 @@ bool CpEdit::cmd_ram(const std::vector<std::string> &args)
         return false;
     }
 
-    auto &data = circuit.ram.at(ram_name_map.at(ram_name)).data;
+    auto id = ram_name_map.at(ram_name);
+    auto &info = *circuit.ram.at(id).info;
 
     if (args.size() == 2) {
-        printf("Width: %lu\n", data.width());
-        printf("Depth: %ld\n", data.depth());
-        printf("Start Offset: %ld\n", data.start_offset());
+        printf("Width: %d\n", info.width);
+        printf("Depth: %d\n", info.depth);
+        printf("Start Offset: %d\n", info.start_offset);
         return true;
     }
 
     int64_t index = std::stol(args[2]);
+    if (index < info.start_offset || index >= info.start_offset + info.depth) {
+        fprintf(stderr, "Index %ld out of range\n", index);
+        return false;
+    }
 
     if (args.size() == 3) {
-        printf("%s\n", data.get(index).bin().c_str());
+        printf("%s\n", circuit.get_ram(id, index - info.start_offset).bin().c_str());
         return true;
     }
 
     std::string value = args[3];
-    if (value.size() != data.width()) {
-        fprintf(stderr, "Value width must be %lu\n", data.width());
+    if (value.size() != size_t(info.width)) {
+        fprintf(stderr, "Value width must be %d\n", info.width);
         return false;
     }
 
-    data.set(index, BitVector(value));
+    circuit.set_ram(id, index - info.start_offset, BitVector(value));
     return true;
 }
 
@@ -249,24 +255,23 @@ bool CpEdit::cmd_ff_dump(const std::vector<std::string> &args)
     }
 
     for (auto &it : circuit.wire) {
+        auto value = circuit.get_wire(it.first);
         printf("%s = %lu'h%s\n",
-            flatten_name(it.first).c_str(),
-            it.second.data.width(), it.second.data.hex().c_str());
+            circuit.names.flat_name(it.first).c_str(),
+            value.width(), value.hex().c_str());
     }
 
     return true;
 }
 
-static void dump_ram(const decltype(*CircuitState::ram.begin()) &it)
+static void dump_ram(LazyCircuitState &circuit, NameTable::id_t id)
 {
-    int width = it.second.data.width();
-    int depth = it.second.data.depth();
-    int start_offset = it.second.data.start_offset();
-    for (int i = 0; i < depth; i++) {
-        auto word = it.second.data.get(i);
+    std::string name = circuit.names.flat_name(id);
+    auto &info = *circuit.ram.at(id).info;
+    for (int i = 0; i < info.depth; i++) {
+        auto word = circuit.get_ram(id, i);
         printf("%s[%d] = %lu'h%s\n",
-            flatten_name(it.first).c_str(),
-            i + start_offset, word.width(), word.hex().c_str());
+            name.c_str(), i + info.start_offset, word.width(), word.hex().c_str());
     }
 }
 
@@ -274,7 +279,7 @@ bool CpEdit::cmd_ram_dump(const std::vector<std::string> &args)
 {
     if (args.size() == 1) {
         for (auto &it : circuit.ram) {
-            dump_ram(it);
+            dump_ram(circuit, it.first);
         }
     }
     else if (args.size() == 2) {
@@ -284,8 +289,7 @@ bool CpEdit::cmd_ram_dump(const std::vector<std::string> &args)
             return false;
         }
 
-        auto it = circuit.ram.find(ram_name_map.at(ram_name));
-        dump_ram(*it);
+        dump_ram(circuit, ram_name_map.at(ram_name));
     }
     else  {
         fprintf(stderr, "Incorrect number of arguments for this command\n");
@@ -352,12 +356,12 @@ CpEdit::CpEdit(const SysInfo &sysinfo, const std::string &ckpt_path) :
     ckpt(ckpt_mgr.open(0)),
     circuit(sysinfo)
 {
-    for (auto &it : sysinfo.wire) {
-        ff_name_map[flatten_name(it.first)] = it.first;
+    for (auto &it : circuit.wire) {
+        ff_name_map[circuit.names.flat_name(it.first)] = it.first;
     }
 
-    for (auto &it : sysinfo.ram) {
-        ram_name_map[flatten_name(it.first)] = it.first;
+    for (auto &it : circuit.ram) {
+        ram_name_map[circuit.names.flat_name(it.first)] = it.first;
     }
 
     for (auto &axi : sysinfo.axi) {
@@ -9,11 +9,11 @@ class CpEdit
 {
     CheckpointManager ckpt_mgr;
     Checkpoint ckpt;
-    CircuitState circuit;
+    LazyCircuitState circuit;
 
     std::unordered_map<std::string, size_t> axi_info;
-    std::unordered_map<std::string, std::vector<std::string>> ff_name_map; // flattened -> original
-    std::unordered_map<std::string, std::vector<std::string>> ram_name_map; // flattened -> original
+    std::unordered_map<std::string, NameTable::id_t> ff_name_map; // flattened -> id in circuit.names
+    std::unordered_map<std::string, NameTable::id_t> ram_name_map; // flattened -> id in circuit.names
 
     std::vector<std::pair<std::string, std::string>> pending_axi_imports; // axi name, file path
 
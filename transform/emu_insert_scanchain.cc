@@ -525,7 +525,7 @@ void ScanchainWorker::instrument_module_ram
             .depth = mem.size,
             .start_offset = mem.start_offset,
             .init_zero = init_zero,
-            .init_data = init_zero ? "" : init_data.as_string(),
+            .init_data = init_zero ? "" : hex_literal(init_data),
             .dissolved = false,
         };
     }
@@ -636,7 +636,7 @@ void ScanchainWorker::instrument_module(Module *module)
             .start_offset = chunk.wire->start_offset,
             .upto = chunk.wire->upto,
             .init_zero = init_zero,
-            .init_data = init_zero ? "" : init_data.as_string(),
+            .init_data = init_zero ? "" : hex_literal(init_data),
         };
     }
 
@@ -51,6 +51,23 @@ inline std::string pretty_name(SigBit bit, bool escape = true)
         return Const(bit.data).as_string();
 }
 
+// Format a constant as <width>'h<hex>, which is parsed by BitVector::from_literal
+// x/z bits are written as 0
+inline std::string hex_literal(const Const &value)
+{
+    int width = GetSize(value);
+    int ndigits = (width + 3) / 4;
+    std::string hex(ndigits, '0');
+    for (int i = 0; i < ndigits; i++) {
+        int digit = 0;
+        for (int j = 0; j < 4 && i * 4 + j < width; j++)
+            if (value[i * 4 + j] == State::S1)
+                digit |= 1 << j;
+        hex[ndigits - 1 - i] = "0123456789abcdef"[digit];
+    }
+    return stringf("%d'h", width) + hex;
+}
+
 inline std::string pretty_name(SigChunk chunk, bool escape = true)
 {
     if (chunk.is_wire()) {
@@ -74,7 +74,7 @@ inline T vpiGetValue(vpiHandle obj, std::enable_if_t<std::is_same_v<T, BitVector
     REMU::BitVector res(size);
     for (int i = 0; i < count; i++) {
         int chunk = value.value.vector[i].aval & ~value.value.vector[i].bval;
-        res.setValue(i * 32, size < 32 ? size : 32, chunk);
+        res.setWord(i * 32, size < 32 ? size : 32, uint32_t(chunk));
         size -= 32;
     }
 
@@ -137,7 +137,31 @@ inline void vpiSetValue(vpiHandle obj, const REMU::BitVector &val, PLI_INT32 fla
 
     s_vpi_vecval vecval[count];
     for (int i = 0; i < count; i++) {
-        vecval[i].aval = val.getValue(i * 32, size < 32 ? size : 32);
+        vecval[i].aval = val.getWord(i * 32, size < 32 ? size : 32);
+        vecval[i].bval = 0;
+        size -= 32;
+    }
+
+    s_vpi_value value;
+    value.format = vpiVectorVal;
+    value.value.vector = vecval;
+
+    s_vpi_time cb_time;
+    cb_time.type = vpiSimTime;
+    cb_time.high = (uint32_t)(time >> 32);
+    cb_time.low  = (uint32_t)time;
+    vpi_put_value(obj, &value, &cb_time, flags);
+}
+
+// The object must be as wide as the view, so that its size is not queried
+inline void vpiSetValue(vpiHandle obj, const REMU::BitVectorView &val, PLI_INT32 flags = vpiNoDelay, uint64_t time = 0)
+{
+    int size = val.width();
+    int count = (size + 31) / 32;
+
+    s_vpi_vecval vecval[count];
+    for (int i = 0; i < count; i++) {
+        vecval[i].aval = val.getWord(i * 32, size < 32 ? size : 32);
         vecval[i].bval = 0;
         size -= 32;
     }